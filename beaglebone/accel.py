@@ -5,130 +5,170 @@ import json
 import urllib2
 import datetime
 import sys
+import threading
+import Queue
 import variance
-import median 
-
-REG_X=0x28
-REG_Y=0x2A
-REG_Z=0x2C
-
-i2c=mraa.I2c(2, True)
-
-i2c.address(0x19)
-
-#Turn the accelometer on
-#Turn on the sensor and set the polling frequency to 50Hz
-i2c.writeReg(0x20, 0x57)
-
-#CTRL_REG4
-#1 - BDU: Block data update. This ensures that both the high and the low bytes for each 16bit represent the same sample
-#0 - BLE: Big/little endian. Set to little endian
-#00 - FS1-FS0: Full scale selection. 00 represents +-2g
-#1 - HR: High resolution mode enabled.
-#00 - ST1-ST0: Self test. Disabled
-#0 - SIM: SPI serial interface mode. Default is 0.
-i2c.writeReg(0x23, 0x88)
-
-def readReg16(address):
-  low = i2c.readReg(address)
-  high = i2c.readReg(address+1)
-  return low | (high << 8)
-
-def uint16ToInt(i):
-  sign = i & 0x8000
-  if sign:
-    return i - 0x10000
-  else:
-    return i
-
-def int16ToFloat(i):
-  sint = uint16ToInt(i)
-  return float(sint) / 16000
+import median
+import lis3dh
+
+#Sensors to monitor, one per machine, given as bus:address
+#eg. python accel.py 2:0x19 2:0x18 1:0x19
+DEFAULT_SENSORS = ["2:0x19"]
+
+#Blynk requests are sent from their own thread so that a slow network
+#never holds up draining the FIFOs. If it falls this far behind, new
+#requests are dropped rather than queued
+maxrequests = 20
+requesttimeout = 10
+requests = Queue.Queue(maxrequests)
+
+def send(req, data):
+  try:
+    requests.put_nowait((req, data))
+  except Queue.Full:
+    sys.stderr.write("Dropped request to {}\n".format(req.get_full_url()))
+
+def sender():
+  while True:
+    req, data = requests.get()
+    try:
+      urllib2.urlopen(req, data, requesttimeout).close()
+    except Exception as e:
+      sys.stderr.write("Request to {} failed: {}\n".format(req.get_full_url(), e))
 
 def notify(msg):
   data = {'body': msg}
   req = urllib2.Request('http://blynk-cloud.com/b3e42dd400e84c5586f122328b83616f/notify')
   req.add_header('Content-Type', 'application/json')
 
-  urllib2.urlopen(req, json.dumps(data))
+  send(req, json.dumps(data))
 
 def push(pin, value):
   req = urllib2.Request('http://blynk-cloud.com/b3e42dd400e84c5586f122328b83616f/update/V' + str(pin))
   req.add_header('Content-Type', 'application/json')
   req.get_method = lambda: 'PUT'
-  urllib2.urlopen(req, "[" + str(value) + "]")
+  send(req, "[" + str(value) + "]")
 
 #Number of samples over which to calculate the variance
 #50 samples represents about 1 second of data
 numSamples = 50
-varx = variance.Variance(numSamples)
-vary = variance.Variance(numSamples)
-varz = variance.Variance(numSamples)
-medx = median.Median(3)
-medy = median.Median(3)
-medz = median.Median(3)
-
-vibrations = 0
-machineon = 0
-lastpush = 0
 vibrationthreshold = 0.05
-lastwakeup = int(round(time.time() * 1000))
 sleeptime = 180 * 1000
 waketime = 5 * 1000
 machineoffdelay = 10 * 60 * 1000
 stayawakethreshold = 50
 machineonthreshold = 5000
+#Time between FIFO drains while awake. The FIFO holds 640ms at 50Hz
+draininterval = 200
+#Time between samples at the 50Hz data rate. The window and thresholds
+#above count samples, so were tuned for this rate
+sampleperiod = 20
+
+class Machine(object):
+  """Vibration tracking for the machine one sensor is attached to"""
+
+  def __init__(self, sensor, out, pin):
+    self.sensor = sensor
+    self.out = out
+    self.pin = pin
+    self.varx = variance.Variance(numSamples)
+    self.vary = variance.Variance(numSamples)
+    self.varz = variance.Variance(numSamples)
+    self.medx = median.Median(3)
+    self.medy = median.Median(3)
+    self.medz = median.Median(3)
+    self.vibrations = 0
+    self.machineon = 0
+    self.lastpush = 0
+
+  def add_sample(self, timestamp, x, y, z):
+    total = math.sqrt(x**2 + y**2 + z**2)
+
+    self.medx.add_variable(x)
+    self.medy.add_variable(y)
+    self.medz.add_variable(z)
+
+    self.varx.add_variable(self.medx.get_median())
+    self.vary.add_variable(self.medy.get_median())
+    self.varz.add_variable(self.medz.get_median())
+
+    v = max(self.varx.get_max(), self.vary.get_max(), self.varz.get_max())
+
+    if v > vibrationthreshold:
+      self.vibrations += 1
+    elif self.vibrations > 0:
+      self.vibrations -= 1
+
+    self.out.write("{},{},{},{},{},{},{}\n".format(timestamp, x, y, z, total, v, self.vibrations))
+
+    if self.vibrations > machineonthreshold:
+      self.machineon = timestamp
+
+  def update(self, timestamp):
+    #If all vibrations have stopped, and the machine was on at least 15 mins ago
+    #then notify
+    if self.vibrations == 0 and self.machineon > 0 and timestamp - self.machineon > machineoffdelay:
+      self.machineon = 0
+      self.out.write("0,0,0,0,0,0,0,Washing done at {}\n".format(timestamp))
+      dt = datetime.datetime.fromtimestamp(timestamp / 1000)
+      if len(machines) > 1:
+        notify("Washing done on {} at {}".format(self.sensor.name(), dt))
+      else:
+        notify("Washing done at {}".format(dt))
+    elif self.vibrations > 0 and timestamp - self.lastpush >= 1000:
+      #Send vibration count to graph with Blynk
+      push(self.pin, self.vibrations)
+      self.lastpush = timestamp
+    self.out.flush()
+
+def on_samples(sensor, timestamp, samples):
+  machine = machines[sensor]
+  #The last sample in the FIFO was taken just before the drain
+  for i, (x, y, z) in enumerate(samples):
+    machine.add_sample(timestamp - (len(samples) - 1 - i) * sampleperiod, x, y, z)
+  machine.update(timestamp)
 
-while True:
-  xint = readReg16(REG_X)
-  yint = readReg16(REG_Y)
-  zint = readReg16(REG_Z)
-  
-  x = int16ToFloat(xint)
-  y = int16ToFloat(yint)
-  z = int16ToFloat(zint)
-  
-  total = math.sqrt(x**2 + y**2 + z**2)
-
-  medx.add_variable(x)
-  medy.add_variable(y)
-  medz.add_variable(z)
- 
-  varx.add_variable(medx.get_median())
-  vary.add_variable(medy.get_median())
-  varz.add_variable(medz.get_median())
-
-  v = max(varx.get_max(), vary.get_max(), varz.get_max())
-
-  if v > vibrationthreshold:
-    vibrations += 1
-  elif vibrations > 0:
-    vibrations -= 1
+lastwakeup = int(round(time.time() * 1000))
+sleepuntil = 0
 
+def interval():
+  global lastwakeup, sleepuntil
   timestamp = int(round(time.time() * 1000))
-  print "{},{},{},{},{},{},{}".format(timestamp, x, y, z, total, v, vibrations)
-  sys.stdout.flush()
-
-  if vibrations > machineonthreshold:
-    machineon = timestamp
-
-  #If all vibrations have stopped, and the machine was on at least 15 mins ago
-  #then notify
-  if vibrations == 0 and machineon > 0 and timestamp - machineon > machineoffdelay:
-    machineon = 0
-    print "0,0,0,0,0,0,0,Washing done at {}".format(timestamp)
-    dt = datetime.datetime.fromtimestamp(timestamp / 1000)
-    notify("Washing done at {}".format(dt))
-  elif vibrations > 0 and timestamp - lastpush >= 1000:
-    #Send vibration count to graph with Blynk
-    push(1, vibrations)
-    lastpush = timestamp
-
-  #Micro sleep as long as there is vibration or we are in our 5 second wake period
-  if vibrations > stayawakethreshold or timestamp - lastwakeup < waketime:
-    time.sleep(0.015)
-  else:
-    #Otherwise sleep for a couple of minutes
-    time.sleep(sleeptime / 1000.0)
-    lastwakeup = int(round(time.time() * 1000))
-
+  #Another bus has already decided we are going to sleep
+  if timestamp < sleepuntil:
+    return (sleepuntil - timestamp) / 1000.0
+  #Keep draining as long as any machine is vibrating or we are in our 5 second wake period
+  if any(m.vibrations > stayawakethreshold for m in machines.values()) or timestamp - lastwakeup < waketime:
+    return draininterval / 1000.0
+  #Otherwise sleep for a couple of minutes
+  sleepuntil = timestamp + sleeptime
+  lastwakeup = sleepuntil
+  return sleeptime / 1000.0
+
+#Machines by sensor
+machines = {}
+
+#Only talk to the sensors when run as a script, so that the filters can be
+#imported on their own, eg. by bench_filter.py
+if __name__ == '__main__':
+  buses = {}
+  names = sys.argv[1:] or DEFAULT_SENSORS
+  for pin, name in enumerate(names, 1):
+    bus, address = name.split(":")
+    bus = int(bus)
+    if bus not in buses:
+      buses[bus] = mraa.I2c(bus, True)
+    sensor = lis3dh.Lis3dh(buses[bus], bus, int(address, 0))
+    sensor.init()
+    #With more than one machine each gets its own log and Blynk pin
+    if len(names) > 1:
+      out = open("accel_{}_{:02x}.log".format(bus, sensor.address), "a")
+    else:
+      out = sys.stdout
+    machines[sensor] = Machine(sensor, out, pin)
+
+  network = threading.Thread(target=sender)
+  network.daemon = True
+  network.start()
+
+  lis3dh.BusScheduler(machines.keys(), on_samples, interval).run()
@@ -0,0 +1,685 @@
+/**
+ * Acquisition daemon for the BeagleBone. Does the work of accel.py and
+ * voltage.py in one process.
+ *
+ * Everything is driven from a single timer wheel: accelerometer FIFO
+ * drains, ADC reads and pushes to Blynk. Each of these has some slack
+ * and runs on the same wake up as anything else due around then, so the
+ * CPU wakes up once rather than once per stream. The pushes only queue
+ * their requests. A sender thread does the network I/O, so a slow DNS
+ * lookup or server never holds up the drains. Every sample is stamped
+ * from CLOCK_MONOTONIC, so the accelerometer and voltage logs line up with
+ * each other. The stamps are written as milliseconds since the epoch, as
+ * the scripts did, using the offset from the wall clock at start up.
+ *
+ * The vibration tracking is the same as accel.py's and the logs have the
+ * same format. With one sensor the accelerometer log goes to stdout, and
+ * with more each sensor gets an accel_<bus>_<address>.log.
+ *
+ * Build with `make -C beaglebone`.
+ *
+ * Usage: acqd [-v voltage log] [-a adc file] [-n] [bus:address...]
+ *   -v  Where to append voltage readings, "-" for stdout. Default voltage.log
+ *   -a  sysfs file for the voltage ADC. Default AIN0, ie. P9_39
+ *   -n  Don't push anything to Blynk
+ *
+ * SIGUSR1 prints wake up and timing statistics to stderr.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "timer_wheel.h"
+#include "vibration.h"
+
+#define BLYNK_HOST "blynk-cloud.com"
+#define BLYNK_TOKEN "b3e42dd400e84c5586f122328b83616f"
+#define HTTP_TIMEOUT_S 5
+#define UPSTREAM_QUEUE 32 /* Requests waiting for the sender thread */
+
+#define DEFAULT_SENSOR "2:0x19"
+#define DEFAULT_ADC "/sys/bus/iio/devices/iio:device0/in_voltage0_raw"
+
+/* LIS3DH registers, see src/lis3dh.h for how the FIFO is read */
+#define CTRL_REG1 0x20
+#define CTRL_REG4 0x23
+#define CTRL_REG5 0x24
+#define REG_X 0x28
+#define FIFO_CTRL_REG 0x2E
+#define FIFO_SRC_REG 0x2F
+#define FIFO_EN 0x40
+#define FIFO_MODE_STREAM 0x80
+#define FIFO_SRC_OVRN 0x40
+#define FIFO_SRC_FSS 0x1f
+#define FIFO_SIZE 32
+#define AUTO_INCREMENT 0x80
+
+#define MAX_SENSORS 16
+#define MAX_BUSES 8
+
+/* Vibration tracking, as in accel.py */
+#define SLEEP_TIME 180000
+#define WAKE_TIME 5000
+#define MACHINE_OFF_DELAY (10 * 60 * 1000)
+#define STAY_AWAKE_THRESHOLD 50
+#define MACHINE_ON_THRESHOLD 5000
+#define DRAIN_INTERVAL 200
+#define SAMPLE_PERIOD 20 /* 50Hz */
+#define PUSH_INTERVAL 1000
+
+/* As in voltage.py. The 5v line is divided down to 1.667v and the ADC
+ * reads 1.8v at full scale */
+#define VOLTAGE_INTERVAL 2000
+#define VOLTAGE_SCALE (1.667 / 1.8)
+#define ADC_FULL_SCALE 4095.0
+
+/* How late each timer can run to share a wake up. Drains set the pace
+ * while we are awake and everything else fits in around them */
+#define DRAIN_SLACK 0
+#define SLEEP_SLACK 5000
+#define VOLTAGE_SLACK 250
+#define PUSH_SLACK 1000
+
+typedef struct machine {
+    int bus;
+    uint8_t address;
+    int pin;
+    FILE *out;
+
+    vibration_filter filter;
+    uint64_t machine_on;
+    uint64_t last_push;
+
+    bool push_pending;
+    long push_value;
+    char notification[128];
+} machine;
+
+typedef struct upstream_request {
+    const char *method;
+    char path[32];
+    char body[160];
+} upstream_request;
+
+/* Requests from the timer callbacks to the sender thread */
+typedef struct upstream_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    upstream_request requests[UPSTREAM_QUEUE];
+    unsigned int head;
+    unsigned int count;
+    unsigned long failures;
+} upstream_queue;
+
+typedef struct i2c_bus {
+    int number;
+    int fd;
+    machine *machines[MAX_SENSORS];
+    int num_machines;
+} i2c_bus;
+
+typedef struct stats {
+    unsigned long wakeups;
+    unsigned long fired;
+    unsigned long drains;
+    unsigned long voltage_reads;
+    unsigned long pushes;
+    unsigned long push_dropped;
+    unsigned long overruns;
+    uint64_t total_late;
+    uint64_t max_late;
+} stats;
+
+static machine machines[MAX_SENSORS];
+static int num_machines;
+static i2c_bus buses[MAX_BUSES];
+static int num_buses;
+
+static timer_wheel wheel;
+static wheel_timer drain_timer;
+static wheel_timer voltage_timer;
+static wheel_timer push_timer;
+
+static int64_t epoch_offset;
+static uint64_t last_wakeup;
+static FILE *voltage_out;
+static int adc_fd;
+static bool upstream = true;
+static upstream_queue outbox = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+static stats counters;
+
+static volatile sig_atomic_t stopping;
+static volatile sig_atomic_t print_stats;
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Milliseconds since the epoch for a time on the monotonic clock
+ */
+static int64_t wall_ms(uint64_t now)
+{
+    return (int64_t)now + epoch_offset;
+}
+
+/**
+ * Format a float the way Python 2's str() does, so the logs match the
+ * scripts' byte for byte
+ */
+static const char *py_float(char *buf, size_t len, double value)
+{
+    snprintf(buf, len, "%.12g", value);
+    if (strspn(buf, "-0123456789") == strlen(buf)) {
+        strncat(buf, ".0", len - strlen(buf) - 1);
+    }
+    return buf;
+}
+
+static void add_sample(machine *m, int64_t timestamp, const double accel[3])
+{
+    double v = vibration_filter_add(&m->filter, accel);
+    double total = sqrt(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+
+    char x[32], y[32], z[32], t[32], vs[32];
+    fprintf(m->out, "%lld,%s,%s,%s,%s,%s,%ld\n", (long long)timestamp,
+            py_float(x, sizeof(x), accel[0]), py_float(y, sizeof(y), accel[1]),
+            py_float(z, sizeof(z), accel[2]), py_float(t, sizeof(t), total),
+            py_float(vs, sizeof(vs), v), m->filter.vibrations);
+
+    if (m->filter.vibrations > MACHINE_ON_THRESHOLD) {
+        m->machine_on = timestamp;
+    }
+}
+
+/**
+ * Queue up anything for Blynk on the push timer, which goes out on
+ * whichever wake up comes along in the next second
+ */
+static void queue_upstream(uint64_t now)
+{
+    if (upstream && !wheel_timer_pending(&push_timer)) {
+        timer_wheel_add(&wheel, &push_timer, now, PUSH_SLACK);
+    }
+}
+
+static void update_machine(machine *m, int64_t timestamp, uint64_t now)
+{
+    //If all vibrations have stopped, and the machine was on at least 10 mins ago
+    //then notify
+    if (m->filter.vibrations == 0 && m->machine_on > 0 && timestamp - (int64_t)m->machine_on > MACHINE_OFF_DELAY) {
+        m->machine_on = 0;
+        fprintf(m->out, "0,0,0,0,0,0,0,Washing done at %lld\n", (long long)timestamp);
+
+        char done[32];
+        time_t seconds = timestamp / 1000;
+        strftime(done, sizeof(done), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+        if (num_machines > 1) {
+            snprintf(m->notification, sizeof(m->notification), "Washing done on %d:0x%02x at %s",
+                     m->bus, m->address, done);
+        } else {
+            snprintf(m->notification, sizeof(m->notification), "Washing done at %s", done);
+        }
+        queue_upstream(now);
+    } else if (m->filter.vibrations > 0 && timestamp - (int64_t)m->last_push >= PUSH_INTERVAL) {
+        //Send vibration count to graph with Blynk
+        m->push_pending = true;
+        m->push_value = m->filter.vibrations;
+        m->last_push = timestamp;
+        queue_upstream(now);
+    }
+    fflush(m->out);
+}
+
+static int write_reg(int fd, uint8_t address, uint8_t reg, uint8_t value)
+{
+    uint8_t buf[2] = { reg, value };
+    struct i2c_msg msg = { address, 0, sizeof(buf), buf };
+    struct i2c_rdwr_ioctl_data data = { &msg, 1 };
+    return ioctl(fd, I2C_RDWR, &data);
+}
+
+static int init_sensor(int fd, uint8_t address)
+{
+    //Turn on the sensor and set the polling frequency to 50Hz
+    if (write_reg(fd, address, CTRL_REG1, 0x47) < 0) {
+        return -1;
+    }
+    //Block data update, little endian, +-2g, high resolution
+    write_reg(fd, address, CTRL_REG4, 0x88);
+    write_reg(fd, address, CTRL_REG5, FIFO_EN);
+    return write_reg(fd, address, FIFO_CTRL_REG, FIFO_MODE_STREAM);
+}
+
+/**
+ * Drain the FIFO of every sensor on a bus in two transfers: one to read
+ * all the FIFO levels and one to burst read all the samples. Returns the
+ * number of samples read from each sensor, or -1 if the bus failed
+ */
+static int drain_bus(i2c_bus *bus, uint8_t data[][FIFO_SIZE * 6], int counts[])
+{
+    struct i2c_msg msgs[MAX_SENSORS * 2];
+    uint8_t src_reg = FIFO_SRC_REG;
+    uint8_t out_reg = REG_X | AUTO_INCREMENT;
+    uint8_t src[MAX_SENSORS];
+    int n = 0;
+
+    for (int i = 0; i < bus->num_machines; i++) {
+        uint8_t address = bus->machines[i]->address;
+        msgs[n++] = (struct i2c_msg){ address, 0, 1, &src_reg };
+        msgs[n++] = (struct i2c_msg){ address, I2C_M_RD, 1, &src[i] };
+    }
+    struct i2c_rdwr_ioctl_data levels = { msgs, n };
+    if (ioctl(bus->fd, I2C_RDWR, &levels) < 0) {
+        return -1;
+    }
+
+    n = 0;
+    for (int i = 0; i < bus->num_machines; i++) {
+        if (src[i] & FIFO_SRC_OVRN) {
+            counters.overruns++;
+        }
+        counts[i] = src[i] & FIFO_SRC_FSS;
+        if (counts[i] == 0) {
+            continue;
+        }
+        uint8_t address = bus->machines[i]->address;
+        msgs[n++] = (struct i2c_msg){ address, 0, 1, &out_reg };
+        msgs[n++] = (struct i2c_msg){ address, I2C_M_RD, counts[i] * 6, data[i] };
+    }
+    if (n == 0) {
+        return 0;
+    }
+    struct i2c_rdwr_ioctl_data samples = { msgs, n };
+    return ioctl(bus->fd, I2C_RDWR, &samples) < 0 ? -1 : 0;
+}
+
+static void record_late(const wheel_timer *t, uint64_t now)
+{
+    uint64_t late = now - t->deadline;
+    counters.fired++;
+    counters.total_late += late;
+    if (late > counters.max_late) {
+        counters.max_late = late;
+    }
+}
+
+static void drain(wheel_timer *t, uint64_t now, void *arg)
+{
+    static uint8_t data[MAX_SENSORS][FIFO_SIZE * 6];
+    int counts[MAX_SENSORS];
+
+    record_late(t, now);
+    counters.drains++;
+
+    for (int b = 0; b < num_buses; b++) {
+        i2c_bus *bus = &buses[b];
+        if (drain_bus(bus, data, counts) < 0) {
+            fprintf(stderr, "i2c-%d: %s\n", bus->number, strerror(errno));
+            continue;
+        }
+        int64_t timestamp = wall_ms(monotonic_ms());
+        for (int i = 0; i < bus->num_machines; i++) {
+            machine *m = bus->machines[i];
+            //The last sample in the FIFO was taken just before the drain
+            for (int s = 0; s < counts[i]; s++) {
+                double accel[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    const uint8_t *p = &data[i][s * 6 + axis * 2];
+                    accel[axis] = (double)(int16_t)(p[0] | (p[1] << 8)) / 16000;
+                }
+                add_sample(m, timestamp - (counts[i] - 1 - s) * SAMPLE_PERIOD, accel);
+            }
+            update_machine(m, timestamp, now);
+        }
+    }
+
+    //Keep draining as long as any machine is vibrating or we are in our 5 second wake period
+    bool awake = now - last_wakeup < WAKE_TIME;
+    for (int i = 0; i < num_machines && !awake; i++) {
+        awake = machines[i].filter.vibrations > STAY_AWAKE_THRESHOLD;
+    }
+    if (awake) {
+        // Keep to the 200ms grid so the drains don't drift
+        uint64_t next = t->deadline + DRAIN_INTERVAL;
+        timer_wheel_add(&wheel, t, next > now ? next : now, DRAIN_SLACK);
+    } else {
+        //Otherwise sleep for a couple of minutes
+        last_wakeup = now + SLEEP_TIME;
+        timer_wheel_add(&wheel, t, now + SLEEP_TIME, SLEEP_SLACK);
+    }
+}
+
+static void read_voltage(wheel_timer *t, uint64_t now, void *arg)
+{
+    char buf[16];
+    char v[32], b[32];
+
+    record_late(t, now);
+    ssize_t len = pread(adc_fd, buf, sizeof(buf) - 1, 0);
+    if (len > 0) {
+        buf[len] = 0;
+        double value = atoi(buf) / ADC_FULL_SCALE;
+        fprintf(voltage_out, "%lld,%s,%s\n", (long long)wall_ms(now),
+                py_float(v, sizeof(v), value), py_float(b, sizeof(b), value / VOLTAGE_SCALE));
+        fflush(voltage_out);
+        counters.voltage_reads++;
+    } else {
+        perror("adc");
+    }
+
+    uint64_t next = t->deadline + VOLTAGE_INTERVAL;
+    timer_wheel_add(&wheel, t, next > now ? next : now, VOLTAGE_SLACK);
+}
+
+/**
+ * Send one request to Blynk and wait for it to be accepted
+ */
+static int blynk_request(const char *method, const char *path, const char *body)
+{
+    const struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    int err = getaddrinfo(BLYNK_HOST, "80", &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", BLYNK_HOST, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    // Don't let the queue back up for long if the network is down
+    struct timeval timeout = { HTTP_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[512];
+    char response[16] = "";
+    int len = snprintf(request, sizeof(request),
+                       "%s /" BLYNK_TOKEN "%s HTTP/1.0\r\n"
+                       "Host: " BLYNK_HOST "\r\n"
+                       "Content-Type: application/json\r\n"
+                       "Content-Length: %zu\r\n"
+                       "\r\n"
+                       "%s", method, path, strlen(body), body);
+    int rc = -1;
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == 0 &&
+        write(fd, request, len) == len &&
+        read(fd, response, sizeof(response) - 1) > 0 &&
+        strncmp(response + 8, " 200", 4) == 0) {
+        rc = 0;
+    } else {
+        fprintf(stderr, "%s %s failed: %s\n", method, path, response[0] ? response : strerror(errno));
+    }
+    close(fd);
+    freeaddrinfo(res);
+    return rc;
+}
+
+/**
+ * Sends the queued requests one at a time, for as long as we run
+ */
+static void *send_upstream(void *arg)
+{
+    while (1) {
+        pthread_mutex_lock(&outbox.lock);
+        while (outbox.count == 0) {
+            pthread_cond_wait(&outbox.ready, &outbox.lock);
+        }
+        upstream_request r = outbox.requests[outbox.head];
+        outbox.head = (outbox.head + 1) % UPSTREAM_QUEUE;
+        outbox.count--;
+        pthread_mutex_unlock(&outbox.lock);
+
+        int rc = blynk_request(r.method, r.path, r.body);
+
+        pthread_mutex_lock(&outbox.lock);
+        outbox.failures += rc < 0;
+        pthread_mutex_unlock(&outbox.lock);
+    }
+    return NULL;
+}
+
+/**
+ * Hand a request to the sender thread. If it has fallen this far behind
+ * the request is dropped rather than waiting
+ */
+static void queue_request(const char *method, const char *path, const char *body)
+{
+    pthread_mutex_lock(&outbox.lock);
+    if (outbox.count == UPSTREAM_QUEUE) {
+        pthread_mutex_unlock(&outbox.lock);
+        fprintf(stderr, "%s %s dropped, the sender is behind\n", method, path);
+        counters.push_dropped++;
+        return;
+    }
+    upstream_request *r = &outbox.requests[(outbox.head + outbox.count) % UPSTREAM_QUEUE];
+    r->method = method;
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    snprintf(r->body, sizeof(r->body), "%s", body);
+    outbox.count++;
+    pthread_cond_signal(&outbox.ready);
+    pthread_mutex_unlock(&outbox.lock);
+    counters.pushes++;
+}
+
+static void push_upstream(wheel_timer *t, uint64_t now, void *arg)
+{
+    char path[32];
+    char body[160];
+
+    record_late(t, now);
+    for (int i = 0; i < num_machines; i++) {
+        machine *m = &machines[i];
+        if (m->notification[0]) {
+            snprintf(body, sizeof(body), "{\"body\": \"%s\"}", m->notification);
+            queue_request("POST", "/notify", body);
+            m->notification[0] = 0;
+        }
+        if (m->push_pending) {
+            snprintf(path, sizeof(path), "/update/V%d", m->pin);
+            snprintf(body, sizeof(body), "[%ld]", m->push_value);
+            queue_request("PUT", path, body);
+            m->push_pending = false;
+        }
+    }
+}
+
+static void dump_stats(void)
+{
+    pthread_mutex_lock(&outbox.lock);
+    unsigned long failures = outbox.failures;
+    pthread_mutex_unlock(&outbox.lock);
+
+    fprintf(stderr, "wakeups: %lu, timers: %lu, drains: %lu, voltage reads: %lu, pushes: %lu (%lu failed, %lu dropped), "
+            "late: %.1fms mean %llums max, fifo overruns: %lu\n",
+            counters.wakeups, counters.fired, counters.drains, counters.voltage_reads, counters.pushes, failures,
+            counters.push_dropped,
+            counters.fired ? (double)counters.total_late / counters.fired : 0.0,
+            (unsigned long long)counters.max_late, counters.overruns);
+}
+
+static void on_signal(int sig)
+{
+    if (sig == SIGUSR1) {
+        print_stats = 1;
+    } else {
+        stopping = 1;
+    }
+}
+
+static i2c_bus *open_bus(int number)
+{
+    for (int i = 0; i < num_buses; i++) {
+        if (buses[i].number == number) {
+            return &buses[i];
+        }
+    }
+    if (num_buses == MAX_BUSES) {
+        fprintf(stderr, "Too many buses\n");
+        return NULL;
+    }
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/i2c-%d", number);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    i2c_bus *bus = &buses[num_buses++];
+    bus->number = number;
+    bus->fd = fd;
+    bus->num_machines = 0;
+    return bus;
+}
+
+static int add_sensor(const char *name, int pin, bool own_log)
+{
+    char *end;
+    int number = strtol(name, &end, 0);
+    if (*end != ':' || num_machines == MAX_SENSORS) {
+        fprintf(stderr, "Bad sensor %s, expected bus:address\n", name);
+        return -1;
+    }
+    int address = strtol(end + 1, NULL, 0);
+
+    i2c_bus *bus = open_bus(number);
+    if (bus == NULL) {
+        return -1;
+    }
+    if (init_sensor(bus->fd, address) < 0) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    machine *m = &machines[num_machines++];
+    memset(m, 0, sizeof(*m));
+    m->bus = number;
+    m->address = address;
+    m->pin = pin;
+    //With more than one machine each gets its own log and Blynk pin
+    if (own_log) {
+        char path[32];
+        snprintf(path, sizeof(path), "accel_%d_%02x.log", number, address);
+        m->out = fopen(path, "a");
+        if (m->out == NULL) {
+            perror(path);
+            return -1;
+        }
+    } else {
+        m->out = stdout;
+    }
+    bus->machines[bus->num_machines++] = m;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *voltage_path = "voltage.log";
+    const char *adc_path = DEFAULT_ADC;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v:a:n")) != -1) {
+        switch (opt) {
+        case 'v': voltage_path = optarg; break;
+        case 'a': adc_path = optarg; break;
+        case 'n': upstream = false; break;
+        default:
+            fprintf(stderr, "Usage: %s [-v voltage log] [-a adc file] [-n] [bus:address...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char *default_sensors[] = { DEFAULT_SENSOR };
+    char **names = optind < argc ? &argv[optind] : default_sensors;
+    int num_names = optind < argc ? argc - optind : 1;
+    for (int i = 0; i < num_names; i++) {
+        if (add_sensor(names[i], i + 1, num_names > 1) < 0) {
+            return 1;
+        }
+    }
+
+    adc_fd = open(adc_path, O_RDONLY);
+    if (adc_fd < 0) {
+        perror(adc_path);
+        return 1;
+    }
+    voltage_out = strcmp(voltage_path, "-") == 0 ? stdout : fopen(voltage_path, "a");
+    if (voltage_out == NULL) {
+        perror(voltage_path);
+        return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (upstream) {
+        // Leave the signals to the main loop, so they wake it up
+        sigset_t blocked, previous;
+        sigfillset(&blocked);
+        pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+        pthread_t sender;
+        int err = pthread_create(&sender, NULL, send_upstream, NULL);
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            return 1;
+        }
+        pthread_detach(sender);
+    }
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t now = monotonic_ms();
+    epoch_offset = (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000 - (int64_t)now;
+    last_wakeup = now;
+
+    // Start on a 64ms boundary. The drain and voltage intervals are multiples
+    // of 8ms, so they then land exactly on the wheel's slots
+    uint64_t start = (now + 63) & ~63ULL;
+    timer_wheel_init(&wheel, now);
+    wheel_timer_init(&drain_timer, drain, NULL);
+    wheel_timer_init(&voltage_timer, read_voltage, NULL);
+    wheel_timer_init(&push_timer, push_upstream, NULL);
+    timer_wheel_add(&wheel, &drain_timer, start, DRAIN_SLACK);
+    timer_wheel_add(&wheel, &voltage_timer, start, VOLTAGE_SLACK);
+
+    while (!stopping) {
+        uint64_t next = timer_wheel_next(&wheel);
+        struct timespec ts = { next / 1000, next % 1000 * 1000000 };
+        int rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        if (print_stats) {
+            print_stats = 0;
+            dump_stats();
+        }
+        if (rc == EINTR) {
+            continue;
+        }
+        counters.wakeups++;
+        timer_wheel_run(&wheel, monotonic_ms());
+    }
+
+    dump_stats();
+    return 0;
+}
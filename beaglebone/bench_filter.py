@@ -0,0 +1,62 @@
+#Times the per sample vibration filter in accel.py, the median, variance
+#and vibration count steps of Machine.add_sample, and prints the result in
+#the same JSON layout as host/bench so the two can be compared, eg.
+#  python bench_filter.py > filter.json
+#  ../host/bench -c filter.json -b filter_baseline.json
+#The total and the CSV line add_sample writes are left out, so this covers
+#the same work as vibration_filter_add on the C side.
+import sys
+import os
+import time
+import types
+import random
+
+#Stand ins for the hardware and network libraries, which accel.py imports
+#but the filters don't use
+for name in ('mraa', 'urllib2'):
+  sys.modules.setdefault(name, types.ModuleType(name))
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import accel
+
+repetitions = 5
+mintime = 0.2
+
+random.seed(1)
+samples = [tuple(random.uniform(-0.125, 0.125) for axis in range(3)) for i in range(1024)]
+
+def filter_sample(machine, x, y, z):
+  machine.medx.add_variable(x)
+  machine.medy.add_variable(y)
+  machine.medz.add_variable(z)
+
+  machine.varx.add_variable(machine.medx.get_median())
+  machine.vary.add_variable(machine.medy.get_median())
+  machine.varz.add_variable(machine.medz.get_median())
+
+  v = max(machine.varx.get_max(), machine.vary.get_max(), machine.varz.get_max())
+
+  if v > accel.vibrationthreshold:
+    machine.vibrations += 1
+  elif machine.vibrations > 0:
+    machine.vibrations -= 1
+  return v
+
+def run(ops):
+  machine = accel.Machine(None, open(os.devnull, 'w'), 1)
+  start = time.time()
+  for i in xrange(ops):
+    x, y, z = samples[i % 1024]
+    filter_sample(machine, x, y, z)
+  return time.time() - start
+
+ops = 1
+while run(ops) < mintime:
+  ops *= 2
+times = sorted(run(ops) for i in range(repetitions))
+ns = times[repetitions // 2] / ops * 1e9
+
+print '{"benchmarks": ['
+print ('  {{"name": "accel.py vibration filter", "op": "sample", "ops": {}, "ns_per_op": {:.6g}, "allocs_per_op": null, '
+       '"cycles_per_op": null, "instructions_per_op": null, "cache_misses_per_op": null, '
+       '"branch_misses_per_op": null}}').format(ops, ns)
+print ']}'
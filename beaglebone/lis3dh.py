@@ -0,0 +1,128 @@
+import sys
+import threading
+import time
+import traceback
+
+LIS3DH_ADDR_LOW=0x18
+LIS3DH_ADDR_HIGH=0x19
+
+#LIS3DH registers, see src/lis3dh.h for how the FIFO is read
+CTRL_REG1=0x20
+CTRL_REG4=0x23
+CTRL_REG5=0x24
+REG_X=0x28
+FIFO_CTRL_REG=0x2E
+FIFO_SRC_REG=0x2F
+
+FIFO_EN=0x40
+FIFO_MODE_STREAM=0x80
+FIFO_SRC_OVRN=0x40
+FIFO_SRC_FSS=0x1f
+
+#Set the MSB of the register address to read several registers in one go
+AUTO_INCREMENT=0x80
+
+def uint16ToInt(i):
+  sign = i & 0x8000
+  if sign:
+    return i - 0x10000
+  else:
+    return i
+
+def int16ToFloat(i):
+  sint = uint16ToInt(i)
+  return float(sint) / 16000
+
+class Lis3dh(object):
+  """One accelerometer on a shared bus. Several of these can share the
+  same mraa.I2c as long as they are only used from that bus's thread"""
+
+  def __init__(self, i2c, bus, address):
+    self.i2c = i2c
+    self.bus = bus
+    self.address = address
+    self.overruns = 0
+
+  def name(self):
+    return "{}:0x{:02x}".format(self.bus, self.address)
+
+  def init(self):
+    self.i2c.address(self.address)
+    #Turn on the sensor and set the polling frequency to 50Hz
+    self.i2c.writeReg(CTRL_REG1, 0x47)
+
+    #CTRL_REG4
+    #1 - BDU: Block data update. This ensures that both the high and the low bytes for each 16bit represent the same sample
+    #0 - BLE: Big/little endian. Set to little endian
+    #00 - FS1-FS0: Full scale selection. 00 represents +-2g
+    #1 - HR: High resolution mode enabled.
+    #00 - ST1-ST0: Self test. Disabled
+    #0 - SIM: SPI serial interface mode. Default is 0.
+    self.i2c.writeReg(CTRL_REG4, 0x88)
+
+    self.i2c.writeReg(CTRL_REG5, FIFO_EN)
+    self.i2c.writeReg(FIFO_CTRL_REG, FIFO_MODE_STREAM)
+
+  def read_fifo(self):
+    """Read every sample waiting in the FIFO as a list of (x, y, z) floats"""
+    self.i2c.address(self.address)
+    src = self.i2c.readReg(FIFO_SRC_REG)
+    if src & FIFO_SRC_OVRN:
+      self.overruns += 1
+    count = src & FIFO_SRC_FSS
+    if count == 0:
+      return []
+    data = self.i2c.readBytesReg(REG_X | AUTO_INCREMENT, count * 6)
+    samples = []
+    for i in range(0, count * 6, 6):
+      x = data[i] | (data[i+1] << 8)
+      y = data[i+2] | (data[i+3] << 8)
+      z = data[i+4] | (data[i+5] << 8)
+      samples.append((int16ToFloat(x), int16ToFloat(y), int16ToFloat(z)))
+    return samples
+
+class BusScheduler(object):
+  """Drains the FIFOs of every sensor on a bus back to back, with one
+  thread per bus so that the buses are read in parallel. callback is
+  called from the bus's thread with the sensor, the time of the drain and
+  its samples, oldest first, and must not block. interval is called after
+  each round to find how long to sleep. It is shared by all the buses so
+  is only called with the lock held"""
+
+  def __init__(self, sensors, callback, interval):
+    self.callback = callback
+    self.interval = interval
+    self.lock = threading.Lock()
+    self.buses = {}
+    for sensor in sensors:
+      self.buses.setdefault(sensor.bus, []).append(sensor)
+
+  def run(self):
+    threads = []
+    for bus, sensors in self.buses.items():
+      thread = threading.Thread(target=self.run_bus, args=(sensors,))
+      thread.daemon = True
+      thread.start()
+      threads.append(thread)
+    while any(t.is_alive() for t in threads):
+      time.sleep(1)
+
+  def run_bus(self, sensors):
+    while True:
+      #Each bus has its own mraa.I2c, only used from this thread, so the
+      #transactions themselves don't need the lock
+      for sensor in sensors:
+        try:
+          samples = sensor.read_fifo()
+          self.callback(sensor, int(round(time.time() * 1000)), samples)
+        except Exception:
+          #Keep draining the other sensors rather than losing the thread
+          sys.stderr.write("Error reading {}\n".format(sensor.name()))
+          traceback.print_exc()
+      try:
+        with self.lock:
+          delay = self.interval()
+      except Exception:
+        traceback.print_exc()
+        delay = 1
+      time.sleep(delay)
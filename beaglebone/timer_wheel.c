@@ -0,0 +1,207 @@
+#include <stddef.h>
+#include "timer_wheel.h"
+
+#define CLK_SHIFT 3 /* Each level is 8 times coarser than the last */
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LVL_SHIFT(n) ((n) * CLK_SHIFT)
+#define LVL_GRAN(n) (1ULL << LVL_SHIFT(n))
+/* Level n holds timers due less than this far ahead. The last slot is
+ * kept free so rounding up can never wrap onto the current one */
+#define LVL_LIMIT(n) ((uint64_t)(TIMER_WHEEL_SLOTS - 1) << LVL_SHIFT(n))
+
+void timer_wheel_init(timer_wheel *w, uint64_t now)
+{
+    w->clk = now;
+    for (int i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+        w->occupied[i] = 0;
+    }
+    for (int i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; i++) {
+        w->slots[i] = NULL;
+    }
+}
+
+void wheel_timer_init(wheel_timer *t, wheel_timer_fn fn, void *arg)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+bool wheel_timer_pending(const wheel_timer *t)
+{
+    return t->pprev != NULL;
+}
+
+static void link_timer(wheel_timer **head, wheel_timer *t)
+{
+    t->next = *head;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static void unlink_timer(wheel_timer *t)
+{
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+static void enqueue(timer_wheel *w, wheel_timer *t)
+{
+    uint64_t expires = t->expires > w->clk ? t->expires : w->clk;
+    uint64_t delta = expires - w->clk;
+    unsigned int lvl = 0;
+
+    while (lvl < TIMER_WHEEL_LEVELS - 1 && delta >= LVL_LIMIT(lvl)) {
+        lvl++;
+    }
+    if (delta >= LVL_LIMIT(lvl)) {
+        // Too far out for the wheel. It gets put back when this comes round
+        expires = w->clk + LVL_LIMIT(lvl) - 1;
+    }
+
+    // Round down to the level's granularity, so we use up less of the
+    // slack. If that takes us before the deadline the timer is put back a
+    // level down when its slot comes round
+    uint64_t pos = expires >> LVL_SHIFT(lvl);
+    t->slot = lvl * TIMER_WHEEL_SLOTS + (pos & SLOT_MASK);
+    link_timer(&w->slots[t->slot], t);
+    w->occupied[lvl] |= 1ULL << (pos & SLOT_MASK);
+}
+
+void timer_wheel_add(timer_wheel *w, wheel_timer *t, uint64_t deadline, uint64_t slack)
+{
+    timer_wheel_del(w, t);
+    t->deadline = deadline;
+    t->expires = deadline + slack < deadline ? UINT64_MAX : deadline + slack;
+    enqueue(w, t);
+}
+
+void timer_wheel_del(timer_wheel *w, wheel_timer *t)
+{
+    if (!wheel_timer_pending(t)) {
+        return;
+    }
+    unlink_timer(t);
+    if (w->slots[t->slot] == NULL) {
+        w->occupied[t->slot / TIMER_WHEEL_SLOTS] &= ~(1ULL << (t->slot & SLOT_MASK));
+    }
+}
+
+uint64_t timer_wheel_next(const timer_wheel *w)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (int lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+        uint64_t occupied = w->occupied[lvl];
+        if (occupied == 0) {
+            continue;
+        }
+        // Every timer on this level is due within 64 slots of the first
+        // slot that is still to come
+        uint64_t pos = (w->clk + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+        unsigned int start = pos & SLOT_MASK;
+        uint64_t rotated = start ? (occupied >> start) | (occupied << (TIMER_WHEEL_SLOTS - start)) : occupied;
+        uint64_t slot_time = (pos + __builtin_ctzll(rotated)) << LVL_SHIFT(lvl);
+        if (slot_time < next) {
+            next = slot_time;
+        }
+    }
+    return next;
+}
+
+/**
+ * Move every timer due at w->clk onto the expired list
+ */
+static void collect(timer_wheel *w, wheel_timer **expired)
+{
+    uint64_t clk = w->clk;
+
+    for (int lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+        unsigned int idx = clk & SLOT_MASK;
+        wheel_timer **head = &w->slots[lvl * TIMER_WHEEL_SLOTS + idx];
+        while (*head) {
+            wheel_timer *t = *head;
+            unlink_timer(t);
+            link_timer(expired, t);
+        }
+        w->occupied[lvl] &= ~(1ULL << idx);
+        // Coarser levels only have a slot due on their own boundaries
+        if (clk & ((1 << CLK_SHIFT) - 1)) {
+            break;
+        }
+        clk >>= CLK_SHIFT;
+    }
+}
+
+/**
+ * Pull in timers that are past their deadline but still have slack left,
+ * so they ride on a wake up that is happening anyway
+ */
+static void collect_coalesced(timer_wheel *w, uint64_t now, wheel_timer **expired)
+{
+    for (int lvl = 0; lvl < TIMER_WHEEL_LEVELS; lvl++) {
+        uint64_t occupied = w->occupied[lvl];
+        while (occupied) {
+            unsigned int idx = __builtin_ctzll(occupied);
+            occupied &= occupied - 1;
+            wheel_timer **head = &w->slots[lvl * TIMER_WHEEL_SLOTS + idx];
+            wheel_timer *t = *head;
+            while (t) {
+                wheel_timer *next = t->next;
+                if (t->deadline <= now) {
+                    unlink_timer(t);
+                    link_timer(expired, t);
+                }
+                t = next;
+            }
+            if (*head == NULL) {
+                w->occupied[lvl] &= ~(1ULL << idx);
+            }
+        }
+    }
+}
+
+unsigned int timer_wheel_run(timer_wheel *w, uint64_t now)
+{
+    wheel_timer *expired = NULL;
+    unsigned int fired = 0;
+
+    while (w->clk <= now) {
+        uint64_t next = timer_wheel_next(w);
+        if (next > now) {
+            break;
+        }
+        w->clk = next;
+        collect(w, &expired);
+        w->clk++;
+    }
+    if (w->clk <= now) {
+        w->clk = now + 1;
+    }
+    if (expired == NULL) {
+        return 0;
+    }
+    collect_coalesced(w, now, &expired);
+
+    while (expired) {
+        wheel_timer *t = expired;
+        unlink_timer(t);
+        if (t->deadline > now) {
+            // Its slack was finer than its level, or it was too far out to
+            // fit on the wheel at all. Try again closer in
+            enqueue(w, t);
+            continue;
+        }
+        t->fn(t, now, t->arg);
+        fired++;
+    }
+    return fired;
+}
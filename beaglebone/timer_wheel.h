@@ -0,0 +1,76 @@
+#ifndef timer_wheel_H_
+#define timer_wheel_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Hierarchical timer wheel in the style of the Linux kernel's. Each level
+ * has 64 slots, eight times coarser than the level below. A timer goes in
+ * the finest level that can hold it, in the last slot before its slack
+ * runs out.
+ *
+ * Each timer has a deadline and some slack. The wheel only has to wake up
+ * for a timer once its slack has run out. When the wheel wakes up for any
+ * reason, every timer that is already past its deadline fires in the same
+ * pass. So that a timer never fires late, one whose slack is finer than
+ * its level is put in the slot before its deadline instead, and moves down
+ * a level when that comes round. Timers with at least their level's
+ * granularity of slack never move, so scheduling them costs the same
+ * however far out they are.
+ *
+ * Times are in milliseconds on whatever monotonic clock the caller uses.
+ */
+
+#define TIMER_WHEEL_LEVELS 6
+#define TIMER_WHEEL_SLOTS 64
+
+typedef struct wheel_timer wheel_timer;
+
+typedef void (*wheel_timer_fn)(wheel_timer *t, uint64_t now, void *arg);
+
+struct wheel_timer {
+    wheel_timer *next;
+    wheel_timer **pprev;
+    uint64_t deadline; /* Earliest time the timer may fire */
+    uint64_t expires;  /* Latest, ie. the deadline plus slack */
+    unsigned int slot;
+    wheel_timer_fn fn;
+    void *arg;
+};
+
+typedef struct timer_wheel {
+    uint64_t clk; /* Next time not yet processed */
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    wheel_timer *slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+} timer_wheel;
+
+void timer_wheel_init(timer_wheel *w, uint64_t now);
+
+void wheel_timer_init(wheel_timer *t, wheel_timer_fn fn, void *arg);
+
+bool wheel_timer_pending(const wheel_timer *t);
+
+/**
+ * (Re)arm t to fire no earlier than deadline and no later than deadline +
+ * slack, as long as timer_wheel_run is called at the time timer_wheel_next
+ * gives. If it is called late, the timer fires on that call
+ */
+void timer_wheel_add(timer_wheel *w, wheel_timer *t, uint64_t deadline, uint64_t slack);
+
+void timer_wheel_del(timer_wheel *w, wheel_timer *t);
+
+/**
+ * When timer_wheel_run next needs to be called, or UINT64_MAX if no
+ * timers are pending
+ */
+uint64_t timer_wheel_next(const timer_wheel *w);
+
+/**
+ * Fire every timer that has expired by now, along with any others that
+ * are past their deadline. Timers may rearm themselves from their
+ * callback. Returns the number of timers fired
+ */
+unsigned int timer_wheel_run(timer_wheel *w, uint64_t now);
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ * Checks timer_wheel.c: that timers fire between their deadline and the
+ * end of their slack, that cancelled timers don't fire, that timers with
+ * little slack cascade down the levels rather than firing late, and that
+ * timers past their deadline ride along on another timer's wake up.
+ *
+ * Run with `make -C beaglebone check`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer_wheel.h"
+
+#define NUM_TIMERS 2000
+#define ROUNDS 20
+
+typedef struct test_timer {
+    wheel_timer timer;
+    uint64_t deadline;
+    uint64_t slack;
+    uint64_t fired_at;
+    int fired;
+    int rearms;
+} test_timer;
+
+static timer_wheel wheel;
+static test_timer timers[NUM_TIMERS];
+static int failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static uint64_t random_below(uint64_t limit)
+{
+    uint64_t r = ((uint64_t)rand() << 31) ^ rand();
+    return r % limit;
+}
+
+/**
+ * Slack from none at all up to well past the top level's granularity
+ */
+static uint64_t random_slack(void)
+{
+    switch (rand() % 4) {
+    case 0: return 0;
+    case 1: return random_below(8);
+    case 2: return random_below(5000);
+    default: return random_below(100000);
+    }
+}
+
+static void arm(test_timer *t, uint64_t deadline, uint64_t slack)
+{
+    t->deadline = deadline;
+    t->slack = slack;
+    timer_wheel_add(&wheel, &t->timer, deadline, slack);
+}
+
+static void on_fire(wheel_timer *timer, uint64_t now, void *arg)
+{
+    test_timer *t = arg;
+
+    CHECK(now >= t->deadline, "timer fired at %llu, before its deadline %llu",
+          (unsigned long long)now, (unsigned long long)t->deadline);
+    CHECK(now <= t->deadline + t->slack, "timer fired at %llu, after %llu + %llu slack",
+          (unsigned long long)now, (unsigned long long)t->deadline, (unsigned long long)t->slack);
+    CHECK(!wheel_timer_pending(timer), "timer still pending in its callback");
+    t->fired++;
+    t->fired_at = now;
+
+    // Some timers rearm themselves, as the drains in acqd do
+    if (t->rearms > 0) {
+        t->rearms--;
+        arm(t, now + random_below(300000), random_slack());
+    }
+}
+
+/**
+ * Run the wheel exactly when it asks to be run until nothing is left
+ */
+static uint64_t run_until_empty(uint64_t now)
+{
+    while (1) {
+        uint64_t next = timer_wheel_next(&wheel);
+        if (next == UINT64_MAX) {
+            return now;
+        }
+        CHECK(next >= now, "next timer %llu is before the last run at %llu",
+              (unsigned long long)next, (unsigned long long)now);
+        now = next;
+        timer_wheel_run(&wheel, now);
+    }
+}
+
+static void test_expiry_bounds(void)
+{
+    uint64_t start = random_below(1ULL << 32);
+    int expected = 0;
+
+    timer_wheel_init(&wheel, start);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        test_timer *t = &timers[i];
+        wheel_timer_init(&t->timer, on_fire, t);
+        t->fired = 0;
+        t->rearms = rand() % 3;
+        expected += 1 + t->rearms;
+        // Up to about ten times what the top level can hold
+        arm(t, start + random_below(20000000), random_slack());
+    }
+    run_until_empty(start);
+
+    int fired = 0;
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        fired += timers[i].fired;
+    }
+    CHECK(fired == expected, "%d timers fired, expected %d", fired, expected);
+}
+
+static void test_cancel(void)
+{
+    uint64_t start = random_below(1ULL << 32);
+    bool cancelled[NUM_TIMERS];
+
+    timer_wheel_init(&wheel, start);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        test_timer *t = &timers[i];
+        wheel_timer_init(&t->timer, on_fire, t);
+        t->fired = 0;
+        t->rearms = 0;
+        arm(t, start + random_below(3000000), random_slack());
+    }
+    // Cancel half, some twice, and rearm some of the rest
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        cancelled[i] = rand() % 2;
+        if (cancelled[i]) {
+            timer_wheel_del(&wheel, &timers[i].timer);
+            CHECK(!wheel_timer_pending(&timers[i].timer), "cancelled timer still pending");
+            if (rand() % 2) {
+                timer_wheel_del(&wheel, &timers[i].timer);
+            }
+        } else if (rand() % 2) {
+            arm(&timers[i], start + random_below(3000000), random_slack());
+        }
+    }
+    run_until_empty(start);
+
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        CHECK(timers[i].fired == !cancelled[i], "timer %d fired %d times, cancelled %d",
+              i, timers[i].fired, cancelled[i]);
+    }
+}
+
+static void test_cascade(void)
+{
+    // Far enough out for the top level, where a slot is 32768ms wide, but
+    // with no slack at all
+    test_timer *t = &timers[0];
+    uint64_t deadline = 1000000 + 12345;
+    int wakeups = 0;
+
+    timer_wheel_init(&wheel, 0);
+    wheel_timer_init(&t->timer, on_fire, t);
+    t->fired = 0;
+    t->rearms = 0;
+    arm(t, deadline, 0);
+
+    while (t->fired == 0) {
+        uint64_t next = timer_wheel_next(&wheel);
+        CHECK(next <= deadline, "wheel asked to run at %llu, after the deadline %llu",
+              (unsigned long long)next, (unsigned long long)deadline);
+        if (next > deadline || ++wakeups > TIMER_WHEEL_LEVELS) {
+            break;
+        }
+        timer_wheel_run(&wheel, next);
+    }
+    CHECK(t->fired == 1 && t->fired_at == deadline, "timer fired at %llu, expected %llu",
+          (unsigned long long)t->fired_at, (unsigned long long)deadline);
+    CHECK(wakeups > 1, "timer didn't cascade");
+
+    // Slack as wide as the slot means it can stay where it is
+    t->fired = 0;
+    arm(t, deadline, 32768);
+    uint64_t next = timer_wheel_next(&wheel);
+    CHECK(next >= deadline && next <= deadline + 32768, "wheel asked to run at %llu for %llu + 32768",
+          (unsigned long long)next, (unsigned long long)deadline);
+}
+
+static void test_coalesce(void)
+{
+    test_timer *lazy = &timers[0];
+    test_timer *strict = &timers[1];
+
+    timer_wheel_init(&wheel, 0);
+    for (int i = 0; i < 2; i++) {
+        wheel_timer_init(&timers[i].timer, on_fire, &timers[i]);
+        timers[i].fired = 0;
+        timers[i].rearms = 0;
+    }
+    // On a slot boundary, so strict doesn't need to cascade
+    arm(lazy, 100, 1000);
+    arm(strict, 496, 0);
+
+    uint64_t next = timer_wheel_next(&wheel);
+    CHECK(next == 496, "wheel asked to run at %llu, expected 496", (unsigned long long)next);
+    unsigned int fired = timer_wheel_run(&wheel, next);
+    CHECK(fired == 2, "%u timers fired at 496, expected both", fired);
+    CHECK(lazy->fired_at == 496, "lazy timer fired at %llu", (unsigned long long)lazy->fired_at);
+    CHECK(timer_wheel_next(&wheel) == UINT64_MAX, "wheel not empty");
+}
+
+static void test_late_run(void)
+{
+    test_timer *t = &timers[0];
+
+    timer_wheel_init(&wheel, 0);
+    wheel_timer_init(&t->timer, on_fire, t);
+    t->fired = 0;
+    t->rearms = 0;
+    // Run long after the slack is up. It has to fire, late, rather than wait
+    // for the wheel to come round again
+    arm(t, 100, 10);
+    t->slack = 100000;
+    CHECK(timer_wheel_run(&wheel, 50000) == 1, "late timer didn't fire");
+}
+
+int main(void)
+{
+    srand(1);
+    for (int i = 0; i < ROUNDS; i++) {
+        test_expiry_bounds();
+        test_cancel();
+    }
+    test_cascade();
+    test_coalesce();
+    test_late_run();
+
+    if (failures) {
+        printf("timer_wheel: %d failures\n", failures);
+        return 1;
+    }
+    printf("timer_wheel: OK\n");
+    return 0;
+}
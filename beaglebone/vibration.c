@@ -0,0 +1,67 @@
+#include "vibration.h"
+
+static void median_add(median3 *m, double value)
+{
+    m->values[m->next] = value;
+    m->next = (m->next + 1) % 3;
+    if (m->count < 3) {
+        m->count++;
+    }
+}
+
+static double median_get(const median3 *m)
+{
+    double a = m->values[0], b = m->values[1], c = m->values[2];
+    if (m->count == 1) {
+        return a;
+    }
+    if (m->count == 2) {
+        return (a + b) / 2;
+    }
+    if ((a <= b && b <= c) || (c <= b && b <= a)) {
+        return b;
+    }
+    if ((b <= a && a <= c) || (c <= a && a <= b)) {
+        return a;
+    }
+    return c;
+}
+
+static void range_add(range_window *r, double value)
+{
+    r->values[r->next] = value;
+    r->next = (r->next + 1) % VIBRATION_WINDOW;
+    if (r->count < VIBRATION_WINDOW) {
+        r->count++;
+    }
+}
+
+static double range_get(const range_window *r)
+{
+    double min = r->values[0], max = r->values[0];
+    for (int i = 1; i < r->count; i++) {
+        if (r->values[i] < min) min = r->values[i];
+        if (r->values[i] > max) max = r->values[i];
+    }
+    return max - min;
+}
+
+double vibration_filter_add(vibration_filter *f, const double accel[3])
+{
+    double v = 0;
+    for (int i = 0; i < 3; i++) {
+        median_add(&f->median[i], accel[i]);
+        range_add(&f->range[i], median_get(&f->median[i]));
+        double range = range_get(&f->range[i]);
+        if (range > v) {
+            v = range;
+        }
+    }
+
+    if (v > VIBRATION_THRESHOLD) {
+        f->vibrations++;
+    } else if (f->vibrations > 0) {
+        f->vibrations--;
+    }
+    return v;
+}
@@ -0,0 +1,38 @@
+#ifndef vibration_H_
+#define vibration_H_
+
+/* Samples over which to take the range, about 1s at 50Hz */
+#define VIBRATION_WINDOW 50
+#define VIBRATION_THRESHOLD 0.05
+
+typedef struct median3 {
+    double values[3];
+    int count;
+    int next;
+} median3;
+
+/* Range of the last VIBRATION_WINDOW values, ie. Variance.get_max() */
+typedef struct range_window {
+    double values[VIBRATION_WINDOW];
+    int count;
+    int next;
+} range_window;
+
+/**
+ * The per sample filter chain from accel.py: a median of 3 on each axis
+ * to drop spikes, then the range of the medians over the window. Start
+ * from all zeroes
+ */
+typedef struct vibration_filter {
+    median3 median[3];
+    range_window range[3];
+    long vibrations;
+} vibration_filter;
+
+/**
+ * Run a sample through the filters and count it towards vibrations if any
+ * axis is over the threshold. Returns the largest range
+ */
+double vibration_filter_add(vibration_filter *f, const double accel[3]);
+
+#endif
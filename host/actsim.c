@@ -0,0 +1,121 @@
+/**
+ * Checks the sensor activity detection mode against a simulated LIS3DH.
+ *
+ * Runs src/activity.c and src/lis3dh.c against the register model, with
+ * the deep sleeps in between replaced by advancing the model until INT2
+ * reaches the level we would be woken by or the timer runs out. Prints
+ * every wake up and what the firmware decided.
+ *
+ * Usage: actsim [-d days] [-n notifications] scenario
+ *
+ * With -n it exits non zero unless exactly that many notifications were
+ * sent, eg. one per wash in the scenario.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "activity.h"
+#include "lis3dh_model.h"
+#include "scenario.h"
+#include "sim.h"
+
+static const char *STATE_NAMES[] = { "idle", "starting", "running", "done" };
+
+static void print_time(uint64_t time_us)
+{
+    uint64_t s = time_us / 1000000;
+    printf("%3llud %02llu:%02llu:%02llu ", (unsigned long long)(s / 86400),
+           (unsigned long long)(s / 3600 % 24), (unsigned long long)(s / 60 % 60),
+           (unsigned long long)(s % 60));
+}
+
+/**
+ * Stand in for deep sleep: run the sensor until INT2 is at the level we
+ * wake on or the timer expires. Returns false if end_us came first
+ */
+static bool sleep_until(lis3dh_model *m, const activity_wakeup *wakeup, uint64_t end_us)
+{
+    uint64_t timer_us = wakeup->timer_seconds ? sim_now_us + (uint64_t)wakeup->timer_seconds * 1000000 : UINT64_MAX;
+
+    while (lis3dh_model_int2(m) != wakeup->wake_on_inactive) {
+        uint64_t next = m->next_sample_us;
+        if (next == 0 || next > timer_us || next > end_us) {
+            sim_now_us = timer_us < end_us ? timer_us : end_us;
+            return sim_now_us == timer_us;
+        }
+        sim_now_us = next;
+        lis3dh_model_advance(m, sim_now_us);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int days = 1;
+    long expected = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+        switch (opt) {
+        case 'd': days = atoi(optarg); break;
+        case 'n': expected = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d days] [-n notifications] scenario\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-d days] [-n notifications] scenario\n", argv[0]);
+        return 2;
+    }
+
+    scenario s;
+    if (scenario_load(&s, argv[optind]) < 0) {
+        return 1;
+    }
+
+    lis3dh_model model;
+    lis3dh_dev dev = { I2C_NUM_0, LIS3DH_ADDR_HIGH };
+    lis3dh_model_init(&model, scenario_signal, &s);
+    lis3dh_model_attach(&model, dev.port, dev.address);
+
+    // Power on
+    init_i2c_bus(dev.port, GPIO_NUM_21, GPIO_NUM_22);
+    if (!init_i2c_device(&dev)) {
+        return 1;
+    }
+    activity_wakeup wakeup;
+    activity_init(&dev, &wakeup);
+
+    machine_state state = MACHINE_IDLE;
+    uint64_t end_us = (uint64_t)days * 86400 * 1000000;
+    unsigned long wakes = 0;
+    unsigned long notifications = 0;
+
+    // The first wake up is for the sensor settling
+    bool awake = sleep_until(&model, &wakeup, end_us);
+
+    while (awake) {
+        wakes++;
+        machine_state previous = state;
+        state = activity_update(&dev, state, lis3dh_model_int2(&model), &wakeup);
+        if (state != previous) {
+            print_time(sim_now_us);
+            printf("%s -> %s\n", STATE_NAMES[previous], STATE_NAMES[state]);
+        }
+        if (state == MACHINE_DONE) {
+            notifications++;
+        }
+        fflush(stdout);
+
+        awake = sleep_until(&model, &wakeup, end_us);
+    }
+
+    printf("Wake ups: %lu, notifications: %lu, sensor samples: %llu\n",
+           wakes, notifications, (unsigned long long)model.samples);
+    if (expected >= 0 && notifications != (unsigned long)expected) {
+        printf("Expected %ld notifications\n", expected);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,612 @@
+/**
+ * Microbenchmarks for the paths every sample goes through.
+ *
+ * Each benchmark is run for long enough to time reliably, a few times
+ * over, and the median of each measurement is reported per operation:
+ * wall time, heap allocations and, where the kernel lets us have them,
+ * hardware counters for cycles, instructions, cache misses and branch
+ * misses. Allocations are counted by wrapping malloc and friends at link
+ * time, so only calls from our own code show up.
+ *
+ * Results are written as JSON with one benchmark per line. Given a
+ * baseline from an earlier run, anything that got slower by more than
+ * the threshold or allocates more is listed and the exit status is 1.
+ * -c compares two result files without running anything, eg. for the
+ * output of beaglebone/bench_filter.py.
+ *
+ * Usage: bench [-r repetitions] [-o results.json] [-b baseline.json] [-t threshold %] [-c results.json] [name...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "lis3dh.h"
+#include "lis3dh_model.h"
+#include "http.h"
+#include "server.h"
+#include "sim.h"
+#include "../beaglebone/vibration.h"
+
+#define MIN_RUN_NS 20000000 /* Time each repetition should take */
+#define MAX_REPETITIONS 31
+#define MAX_RESULTS 32
+#define BATCH 32 /* A full FIFO */
+
+float getAccel(int16_t accel);
+
+/* What the benchmarks write their results to so they aren't optimised away */
+static volatile double sink;
+
+/* Measurement */
+
+enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NUM_COUNTERS };
+
+static const char *COUNTER_NAMES[NUM_COUNTERS] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+};
+static const uint64_t COUNTER_CONFIG[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int group_fd = -1;
+static int counter_slot[NUM_COUNTERS]; /* Position in the group read, or -1 */
+static int num_counters;
+
+static bool measuring;
+static uint64_t started_ns;
+static uint64_t elapsed_ns;
+static unsigned long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations += measuring;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    allocations += measuring;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations += measuring;
+    return __real_realloc(ptr, size);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int perf_open(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * Open whichever counters we can. Virtual machines often have none, and
+ * perf_event_paranoid can rule them out, in which case they are reported
+ * as null
+ */
+static void open_counters(void)
+{
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        counter_slot[i] = -1;
+        int fd = perf_open(COUNTER_CONFIG[i], group_fd);
+        if (fd < 0) {
+            continue;
+        }
+        if (group_fd < 0) {
+            group_fd = fd;
+        }
+        counter_slot[i] = num_counters++;
+    }
+    if (group_fd < 0) {
+        fprintf(stderr, "Hardware counters unavailable, reporting times and allocations only\n");
+    }
+}
+
+static void bench_resume(void)
+{
+    if (group_fd >= 0) {
+        ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    measuring = true;
+    started_ns = now_ns();
+}
+
+/**
+ * Stop measuring, eg. while setting up for the next operation
+ */
+static void bench_pause(void)
+{
+    elapsed_ns += now_ns() - started_ns;
+    measuring = false;
+    if (group_fd >= 0) {
+        ioctl(group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/* Benchmarks. run() is entered measuring and returns the number of
+ * operations it did, which may be rounded up from the number asked for */
+
+typedef struct benchmark {
+    const char *name;
+    const char *op;
+    void (*setup)(void);
+    unsigned long (*run)(unsigned long ops);
+} benchmark;
+
+static const lis3dh_dev accel_dev = { I2C_NUM_0, LIS3DH_ADDR_HIGH };
+static lis3dh_model accel_model;
+static uint8_t fifo_data[BATCH * 6];
+static accel_values raw_samples[BATCH];
+static double samples[1024][3];
+
+static void shake(uint64_t time_us, int16_t raw[3], void *ctx)
+{
+    raw[0] = (int16_t)(time_us * 7919);
+    raw[1] = (int16_t)(time_us * 104729);
+    raw[2] = 16000;
+}
+
+static void setup_accelerometer(void)
+{
+    static bool attached;
+    if (attached) {
+        return;
+    }
+    attached = true;
+    lis3dh_model_init(&accel_model, shake, NULL);
+    lis3dh_model_attach(&accel_model, accel_dev.port, accel_dev.address);
+    init_i2c_bus(accel_dev.port, GPIO_NUM_21, GPIO_NUM_22);
+    init_i2c_device(&accel_dev);
+    write_reg(&accel_dev, CTRL_REG1, 0x77); // 400hz
+    write_reg(&accel_dev, CTRL_REG4, 0x88);
+}
+
+static unsigned long run_read_acceleration(unsigned long ops)
+{
+    for (unsigned long i = 0; i < ops; i++) {
+        sim_now_us += 2500;
+        accel_values v = read_acceleration(&accel_dev);
+        sink = v.x + v.y + v.z;
+    }
+    return ops;
+}
+
+static void setup_decode(void)
+{
+    for (int i = 0; i < (int)sizeof(fifo_data); i++) {
+        fifo_data[i] = i * 37;
+    }
+}
+
+static unsigned long run_decode_acceleration(unsigned long ops)
+{
+    unsigned long batches = (ops + BATCH - 1) / BATCH;
+    accel_values values[BATCH];
+    for (unsigned long i = 0; i < batches; i++) {
+        decode_acceleration(fifo_data, values, BATCH);
+        sink = values[i % BATCH].x;
+    }
+    return batches * BATCH;
+}
+
+static void setup_samples(void)
+{
+    unsigned int seed = 1;
+    for (int i = 0; i < BATCH; i++) {
+        raw_samples[i].x = rand_r(&seed);
+        raw_samples[i].y = rand_r(&seed);
+        raw_samples[i].z = 16000 + rand_r(&seed) % 512;
+    }
+    for (int i = 0; i < 1024; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            samples[i][axis] = (double)(int16_t)rand_r(&seed) / 16000 / 8;
+        }
+    }
+}
+
+static unsigned long run_get_accel(unsigned long ops)
+{
+    float total = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        const accel_values *v = &raw_samples[i % BATCH];
+        total += getAccel(v->x) + getAccel(v->y) + getAccel(v->z);
+    }
+    sink = total;
+    return ops;
+}
+
+static unsigned long run_vibration_filter(unsigned long ops)
+{
+    static vibration_filter filter;
+    double total = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        total += vibration_filter_add(&filter, samples[i % 1024]);
+    }
+    sink = total;
+    return ops;
+}
+
+static const char *HTTP_RESPONSE = "HTTP/1.1 200 OK\r\n"
+    "Server: nginx\r\n"
+    "Date: Thu, 01 Jun 2017 19:23:02 GMT\r\n"
+    "Content-Type: text/plain;charset=utf-8\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static unsigned long run_http_response(unsigned long ops)
+{
+    for (unsigned long i = 0; i < ops; i++) {
+        int fds[2];
+        bench_pause();
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+            write(fds[1], HTTP_RESPONSE, strlen(HTTP_RESPONSE)) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        shutdown(fds[1], SHUT_WR);
+        bench_resume();
+
+        sink = read_http_response(fds[0]);
+
+        bench_pause();
+        close(fds[0]);
+        close(fds[1]);
+        bench_resume();
+    }
+    return ops;
+}
+
+static unsigned long run_socket_send(unsigned long ops)
+{
+    static int fds[2] = { -1, -1 };
+    static char line[] = "1496345000000,0.0125,-0.00625,0.998125\n";
+    char buf[65536];
+
+    if (fds[0] < 0) {
+        bench_pause();
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        bench_resume();
+    }
+    for (unsigned long i = 0; i < ops; i++) {
+        if (socket_send(fds[0], line, sizeof(line) - 1, 0) < 0) {
+            perror("socket_send");
+            exit(1);
+        }
+        if (i % 256 == 255) {
+            // Play the client and keep the socket buffer from filling up
+            bench_pause();
+            while (read(fds[1], buf, sizeof(buf)) > 0) {
+            }
+            bench_resume();
+        }
+    }
+    bench_pause();
+    while (read(fds[1], buf, sizeof(buf)) > 0) {
+    }
+    bench_resume();
+    return ops;
+}
+
+/* server.c hands accepted connections to this, which the firmware doesn't have */
+bool client_connected(int clientSocket)
+{
+    return false;
+}
+
+static const benchmark BENCHMARKS[] = {
+    { "read_acceleration", "sample", setup_accelerometer, run_read_acceleration },
+    { "decode_acceleration", "sample", setup_decode, run_decode_acceleration },
+    { "getAccel", "sample", setup_samples, run_get_accel },
+    { "vibration_filter", "sample", setup_samples, run_vibration_filter },
+    { "read_http_response", "response", NULL, run_http_response },
+    { "socket_send", "send", NULL, run_socket_send },
+};
+
+/* Results */
+
+typedef struct result {
+    char name[64];
+    char op[16];
+    unsigned long ops;
+    double ns;
+    double allocs; /* NAN if unknown */
+    double counters[NUM_COUNTERS]; /* NAN if unavailable */
+} result;
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *values, int count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+    return values[count / 2];
+}
+
+/**
+ * Time one repetition of ops operations, filling in per operation figures
+ */
+static void measure(const benchmark *b, unsigned long ops, double *ns, double *allocs, double counters[])
+{
+    struct { uint64_t nr; uint64_t values[NUM_COUNTERS]; } group;
+
+    elapsed_ns = 0;
+    allocations = 0;
+    if (group_fd >= 0) {
+        ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    }
+    bench_resume();
+    ops = b->run(ops);
+    bench_pause();
+
+    *ns = (double)elapsed_ns / ops;
+    *allocs = (double)allocations / ops;
+    bool have_group = group_fd >= 0 && read(group_fd, &group, sizeof(group)) > 0;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        counters[i] = have_group && counter_slot[i] >= 0 ? (double)group.values[counter_slot[i]] / ops : NAN;
+    }
+}
+
+static void run_benchmark(const benchmark *b, int repetitions, result *r)
+{
+    double ns[MAX_REPETITIONS], allocs[MAX_REPETITIONS];
+    double counters[NUM_COUNTERS][MAX_REPETITIONS];
+    double c[NUM_COUNTERS];
+
+    if (b->setup) {
+        b->setup();
+    }
+    // Warm up, and find how many operations make a long enough run
+    unsigned long ops = 1;
+    while (1) {
+        measure(b, ops, &ns[0], &allocs[0], c);
+        if (ns[0] * ops >= MIN_RUN_NS || ops >= 1UL << 30) {
+            break;
+        }
+        ops *= 2;
+    }
+
+    for (int i = 0; i < repetitions; i++) {
+        measure(b, ops, &ns[i], &allocs[i], c);
+        for (int j = 0; j < NUM_COUNTERS; j++) {
+            counters[j][i] = c[j];
+        }
+    }
+
+    snprintf(r->name, sizeof(r->name), "%s", b->name);
+    snprintf(r->op, sizeof(r->op), "%s", b->op);
+    r->ops = ops;
+    r->ns = median(ns, repetitions);
+    r->allocs = median(allocs, repetitions);
+    for (int j = 0; j < NUM_COUNTERS; j++) {
+        r->counters[j] = median(counters[j], repetitions);
+    }
+}
+
+static void print_number(FILE *f, const char *key, double value)
+{
+    if (isnan(value)) {
+        fprintf(f, ", \"%s\": null", key);
+    } else {
+        fprintf(f, ", \"%s\": %.6g", key, value);
+    }
+}
+
+static void write_results(FILE *f, const result *results, int count)
+{
+    fprintf(f, "{\"benchmarks\": [\n");
+    for (int i = 0; i < count; i++) {
+        const result *r = &results[i];
+        fprintf(f, "  {\"name\": \"%s\", \"op\": \"%s\", \"ops\": %lu", r->name, r->op, r->ops);
+        print_number(f, "ns_per_op", r->ns);
+        print_number(f, "allocs_per_op", r->allocs);
+        for (int j = 0; j < NUM_COUNTERS; j++) {
+            char key[32];
+            snprintf(key, sizeof(key), "%s_per_op", COUNTER_NAMES[j]);
+            print_number(f, key, r->counters[j]);
+        }
+        fprintf(f, "}%s\n", i < count - 1 ? "," : "");
+    }
+    fprintf(f, "]}\n");
+}
+
+static double read_number(const char *line, const char *key)
+{
+    char pattern[48];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL || strncmp(p + strlen(pattern), "null", 4) == 0) {
+        return NAN;
+    }
+    return atof(p + strlen(pattern));
+}
+
+/**
+ * Read results back from a file written by write_results. Only our own
+ * layout is understood, one benchmark per line. Returns the number read
+ * or -1 if the file couldn't be opened
+ */
+static int read_results(const char *path, result *results, int max)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[1024];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), f)) {
+        result *r = &results[count];
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"op\": \"%15[^\"]\", \"ops\": %lu",
+                   r->name, r->op, &r->ops) != 3) {
+            continue;
+        }
+        r->ns = read_number(line, "ns_per_op");
+        r->allocs = read_number(line, "allocs_per_op");
+        for (int j = 0; j < NUM_COUNTERS; j++) {
+            char key[32];
+            snprintf(key, sizeof(key), "%s_per_op", COUNTER_NAMES[j]);
+            r->counters[j] = read_number(line, key);
+        }
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+/**
+ * Print how each result compares to the baseline. Returns the number of
+ * regressions
+ */
+static int compare(FILE *f, const result *results, int count, const result *baseline, int baseline_count,
+                   double threshold)
+{
+    int regressions = 0;
+
+    fprintf(f, "%-22s %12s %12s %8s %14s\n", "benchmark", "baseline ns", "ns", "change", "allocs");
+    for (int i = 0; i < count; i++) {
+        const result *r = &results[i];
+        const result *base = NULL;
+        for (int j = 0; j < baseline_count; j++) {
+            if (strcmp(baseline[j].name, r->name) == 0) {
+                base = &baseline[j];
+            }
+        }
+        if (base == NULL) {
+            fprintf(f, "%-22s %12s %12.1f %8s\n", r->name, "-", r->ns, "new");
+            continue;
+        }
+        double change = (r->ns - base->ns) / base->ns * 100;
+        // Allocation counts are exact, so any increase counts
+        bool slower = change > threshold;
+        bool allocates = !isnan(r->allocs) && !isnan(base->allocs) && r->allocs > base->allocs + 1e-6;
+        fprintf(f, "%-22s %12.1f %12.1f %+7.1f%% %6.2f -> %-5.2f%s\n", r->name, base->ns, r->ns, change,
+                base->allocs, r->allocs, slower || allocates ? "  REGRESSION" : "");
+        regressions += slower || allocates;
+    }
+    return regressions;
+}
+
+static bool selected(const char *name, char **names, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return true;
+        }
+    }
+    return count == 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-r repetitions] [-o results.json] [-b baseline.json] [-t threshold %%] "
+            "[-c results.json] [name...]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int repetitions = 5;
+    const char *output = NULL;
+    const char *baseline_path = NULL;
+    const char *compare_path = NULL;
+    double threshold = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:o:b:t:c:")) != -1) {
+        switch (opt) {
+        case 'r': repetitions = atoi(optarg); break;
+        case 'o': output = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        case 'c': compare_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS || (compare_path && !baseline_path)) {
+        usage(argv[0]);
+    }
+
+    static result results[MAX_RESULTS];
+    static result baseline[MAX_RESULTS];
+    int count = 0;
+    int baseline_count = 0;
+
+    if (baseline_path && (baseline_count = read_results(baseline_path, baseline, MAX_RESULTS)) < 0) {
+        return 1;
+    }
+
+    if (compare_path) {
+        if ((count = read_results(compare_path, results, MAX_RESULTS)) < 0) {
+            return 1;
+        }
+    } else {
+        // The firmware prints as it goes. Keep stdout for the results
+        FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            perror("/dev/null");
+            return 1;
+        }
+        open_counters();
+        for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); i++) {
+            if (selected(BENCHMARKS[i].name, &argv[optind], argc - optind)) {
+                run_benchmark(&BENCHMARKS[i], repetitions, &results[count]);
+                fprintf(stderr, "%-22s %10.1f ns/%s\n", results[count].name, results[count].ns, results[count].op);
+                count++;
+            }
+        }
+
+        FILE *f = output ? fopen(output, "w") : report;
+        if (f == NULL) {
+            perror(output);
+            return 1;
+        }
+        write_results(f, results, count);
+        fclose(f);
+    }
+
+    if (baseline_path) {
+        int regressions = compare(stderr, results, count, baseline, baseline_count, threshold);
+        if (regressions) {
+            fprintf(stderr, "%d regression%s over %.0f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef emu_H_
+#define emu_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_deep_sleep.h"
+#include "lis3dh_model.h"
+
+/* GPIOs the accelerometer interrupts are wired to, as in src/main.c */
+#define EMU_INT1_PIN GPIO_NUM_32
+#define EMU_INT2_PIN GPIO_NUM_33
+
+typedef enum {
+    EMU_RUN_SLEEP,    /* esp_deep_sleep_start() was called */
+    EMU_RUN_IDLE,     /* Every task has finished without going to sleep */
+    EMU_RUN_WATCHDOG, /* Still awake when the deadline passed */
+} emu_run_result;
+
+/**
+ * State of the emulated board that survives deep sleep
+ */
+typedef struct emu_device {
+    lis3dh_model accel;
+
+    /* Wake sources armed for the next deep sleep */
+    bool ext0_enabled;
+    gpio_num_t ext0_pin;
+    int ext0_level;
+    uint64_t timer_us;
+    esp_deep_sleep_wakeup_cause_t wakeup_cause;
+
+    bool radio_on;
+    uint64_t radio_on_since_us;
+    uint64_t radio_on_us;
+    bool connected;
+
+    double battery_used_mah;
+    double battery_capacity_mah;
+
+    unsigned long http_requests;
+    unsigned long http_responses;
+} emu_device;
+
+extern emu_device emu;
+
+/**
+ * Called at the start of each boot to forget anything the chip
+ * doesn't keep through deep sleep
+ */
+void emu_reset_peripherals(void);
+
+/**
+ * Level of one of the pins the accelerometer drives
+ */
+int emu_accel_pin(gpio_num_t pin);
+
+/**
+ * Block the running task for the given simulated time, eg. while
+ * waiting on the network
+ */
+void emu_block_us(uint64_t us);
+
+/**
+ * Run a callback from the scheduler once the simulated clock reaches at_us.
+ * This is how asynchronous events such as the Wi-Fi connecting arrive
+ */
+void emu_post_callback(uint64_t at_us, void (*fn)(void *), void *arg);
+
+/**
+ * Start entry as the first task and run the scheduler until the
+ * firmware deep sleeps, runs out of things to do, or deadline_us passes
+ */
+emu_run_result emu_run_tasks(void (*entry)(void), uint64_t deadline_us);
+
+/**
+ * Stop the running task and hand back to emu_run_tasks to deep sleep
+ */
+void emu_enter_deep_sleep(void) __attribute__((noreturn));
+
+#endif
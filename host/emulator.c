@@ -0,0 +1,253 @@
+/**
+ * Runs the real firmware through days of deep sleep and wake ups in a
+ * few seconds.
+ *
+ * The firmware is built as a shared library and loaded afresh on every
+ * boot, which resets its globals just like a wake from deep sleep does.
+ * Only the RTC_DATA_ATTR variables are copied over from the last boot.
+ * While the firmware is awake its tasks run on a simulated clock (see
+ * freertos_emu.c), and while it sleeps the accelerometer model is run on
+ * its own until one of the armed wake sources fires. The clock only ever
+ * jumps from one event to the next, so a day of sleeping costs as much
+ * as the samples the sensor takes in it.
+ *
+ * At the end it reports how often the board woke, how long it stayed
+ * awake, how long the radio was on and the charge all of that used.
+ *
+ * Usage: emulator [-d days] [-c capacity mAh] [-w watchdog seconds] [-v] firmware.so scenario
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <time.h>
+#include "emu.h"
+#include "scenario.h"
+#include "lis3dh.h"
+#include "sim.h"
+
+#define BOOT_US 200000 /* Reset to app_main, mostly the bootloader */
+
+/* Supply current in mA */
+#define CPU_MA 40.0
+#define RADIO_MA 80.0 /* On top of the CPU */
+#define DEEP_SLEEP_MA 0.010
+
+#define US_PER_HOUR 3600e6
+
+static const char *CAUSE_NAMES[] = { "power on", "ext0", "ext1", "timer", "touchpad", "ulp" };
+
+static FILE *report;
+static bool verbose;
+
+/**
+ * LIS3DH supply current at each data rate in normal mode, from the datasheet
+ */
+static double accel_ma(const lis3dh_model *m)
+{
+    static const struct { unsigned int hz; double ua; } CURRENT[] = {
+        { 1, 2 }, { 10, 4 }, { 25, 6 }, { 50, 11 }, { 100, 20 }, { 200, 38 }, { 400, 73 },
+    };
+    uint64_t period = lis3dh_model_period_us(m);
+    if (period == 0) {
+        return 0.0005; // Power down mode
+    }
+    unsigned int hz = 1000000 / period;
+    for (size_t i = 0; i < sizeof(CURRENT) / sizeof(CURRENT[0]); i++) {
+        if (hz <= CURRENT[i].hz) {
+            return CURRENT[i].ua / 1000;
+        }
+    }
+    return 0.185; // 1.344khz
+}
+
+static void use_charge(double ma, uint64_t us)
+{
+    emu.battery_used_mah += ma * us / US_PER_HOUR;
+}
+
+static void print_time(FILE *f, uint64_t time_us)
+{
+    uint64_t s = time_us / 1000000;
+    fprintf(f, "%3llud %02llu:%02llu:%02llu ", (unsigned long long)(s / 86400),
+            (unsigned long long)(s / 3600 % 24), (unsigned long long)(s / 60 % 60),
+            (unsigned long long)(s % 60));
+}
+
+static bool ext0_triggered(void)
+{
+    return emu.ext0_enabled && emu_accel_pin(emu.ext0_pin) == emu.ext0_level;
+}
+
+/**
+ * Deep sleep until a wake source fires. Returns false if end_us came first
+ */
+static bool deep_sleep(uint64_t end_us)
+{
+    uint64_t timer_us = emu.timer_us ? sim_now_us + emu.timer_us : UINT64_MAX;
+
+    while (!ext0_triggered()) {
+        uint64_t next = emu.accel.next_sample_us;
+        if (!emu.ext0_enabled || next == 0 || next > timer_us || next > end_us) {
+            next = timer_us < end_us ? timer_us : end_us;
+            use_charge(DEEP_SLEEP_MA + accel_ma(&emu.accel), next - sim_now_us);
+            sim_now_us = next;
+            if (next == end_us) {
+                return false;
+            }
+            emu.wakeup_cause = ESP_DEEP_SLEEP_WAKEUP_TIMER;
+            return true;
+        }
+        // The data rate can change as we go, so charge sample by sample
+        use_charge(DEEP_SLEEP_MA + accel_ma(&emu.accel), next - sim_now_us);
+        sim_now_us = next;
+    }
+    emu.wakeup_cause = ESP_DEEP_SLEEP_WAKEUP_EXT0;
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-d days] [-c capacity mAh] [-w watchdog seconds] [-v] firmware.so scenario\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int days = 7;
+    double capacity_mah = 2000;
+    uint64_t watchdog_us = 3600ULL * 1000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:c:w:v")) != -1) {
+        switch (opt) {
+        case 'd': days = atoi(optarg); break;
+        case 'c': capacity_mah = atof(optarg); break;
+        case 'w': watchdog_us = (uint64_t)atoi(optarg) * 1000000; break;
+        case 'v': verbose = true; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2) {
+        usage(argv[0]);
+    }
+    // dlopen only looks in the current directory when given a path
+    char firmware[4096];
+    snprintf(firmware, sizeof(firmware), "%s%s", strchr(argv[optind], '/') ? "" : "./", argv[optind]);
+
+    scenario s;
+    if (scenario_load(&s, argv[optind + 1]) < 0) {
+        return 1;
+    }
+
+    // The firmware talks a lot. Keep our own copy of stdout for the report
+    // and only let the firmware's through when asked to
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose && freopen("/dev/null", "w", stdout) == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    lis3dh_model_init(&emu.accel, scenario_signal, &s);
+    lis3dh_model_attach(&emu.accel, I2C_NUM_0, LIS3DH_ADDR_HIGH);
+    emu.battery_capacity_mah = capacity_mah;
+    emu.wakeup_cause = ESP_DEEP_SLEEP_WAKEUP_UNDEFINED;
+
+    uint64_t end_us = (uint64_t)days * 86400 * 1000000;
+    char *rtc_saved = NULL;
+    size_t rtc_size = 0;
+    unsigned long boots = 0;
+    unsigned long boots_by_cause[sizeof(CAUSE_NAMES) / sizeof(CAUSE_NAMES[0])] = { 0 };
+    uint64_t awake_us = 0;
+    uint64_t longest_awake_us = 0;
+    int status = 0;
+    clock_t started = clock();
+
+    while (1) {
+        boots++;
+        boots_by_cause[emu.wakeup_cause]++;
+        if (verbose) {
+            print_time(report, sim_now_us);
+            fprintf(report, "boot %lu (%s)\n", boots, CAUSE_NAMES[emu.wakeup_cause]);
+            fflush(report);
+        }
+
+        void *handle = dlopen(firmware, RTLD_NOW | RTLD_LOCAL);
+        if (handle == NULL) {
+            fprintf(stderr, "%s\n", dlerror());
+            return 1;
+        }
+        char *(*rtc_start)(void) = (char *(*)(void))dlsym(handle, "emu_rtc_start");
+        size_t (*rtc_size_fn)(void) = (size_t (*)(void))dlsym(handle, "emu_rtc_size");
+        void (*app_main)(void) = (void (*)(void))dlsym(handle, "app_main");
+        if (rtc_start == NULL || rtc_size_fn == NULL || app_main == NULL) {
+            fprintf(stderr, "%s: not built for the emulator\n", firmware);
+            return 1;
+        }
+        if (rtc_saved == NULL) {
+            rtc_size = rtc_size_fn();
+            rtc_saved = malloc(rtc_size);
+            memcpy(rtc_saved, rtc_start(), rtc_size);
+        } else {
+            memcpy(rtc_start(), rtc_saved, rtc_size);
+        }
+
+        emu_reset_peripherals();
+        uint64_t boot_us = sim_now_us;
+        sim_now_us += BOOT_US;
+        emu_run_result result = emu_run_tasks(app_main, boot_us + watchdog_us);
+        fflush(stdout);
+
+        memcpy(rtc_saved, rtc_start(), rtc_size);
+        dlclose(handle);
+
+        uint64_t awake = sim_now_us - boot_us;
+        awake_us += awake;
+        if (awake > longest_awake_us) {
+            longest_awake_us = awake;
+        }
+        use_charge(CPU_MA + accel_ma(&emu.accel), awake);
+        if (emu.radio_on) {
+            uint64_t radio = sim_now_us - emu.radio_on_since_us;
+            emu.radio_on_us += radio;
+            use_charge(RADIO_MA, radio);
+            emu.radio_on = false;
+        }
+
+        if (result != EMU_RUN_SLEEP) {
+            print_time(report, sim_now_us);
+            fprintf(report, "boot %lu %s\n", boots, result == EMU_RUN_IDLE ?
+                    "stopped without going to sleep" : "still awake when the watchdog expired");
+            status = 1;
+            break;
+        }
+        if (sim_now_us >= end_us || !deep_sleep(end_us)) {
+            break;
+        }
+    }
+
+    double seconds = sim_now_us / 1e6;
+    double sim_days = seconds / 86400;
+    double average_ma = emu.battery_used_mah / (seconds / 3600);
+
+    fprintf(report, "Simulated %.2f days in %.2fs\n", sim_days, (double)(clock() - started) / CLOCKS_PER_SEC);
+    fprintf(report, "Boots: %lu (%.1f per day)", boots, boots / sim_days);
+    for (size_t i = 0; i < sizeof(CAUSE_NAMES) / sizeof(CAUSE_NAMES[0]); i++) {
+        if (boots_by_cause[i]) {
+            fprintf(report, ", %s: %lu", CAUSE_NAMES[i], boots_by_cause[i]);
+        }
+    }
+    fprintf(report, "\n");
+    fprintf(report, "Awake: %.1fs total, %.2fs average, %.1fs longest\n",
+            awake_us / 1e6, awake_us / 1e6 / boots, longest_awake_us / 1e6);
+    fprintf(report, "Radio on: %.1fs, HTTP requests: %lu, responses: %lu\n",
+            emu.radio_on_us / 1e6, emu.http_requests, emu.http_responses);
+    fprintf(report, "Charge used: %.3fmAh, average current: %.1fuA\n",
+            emu.battery_used_mah, average_ma * 1000);
+    if (average_ma > 0) {
+        fprintf(report, "Battery life on %.0fmAh: %.0f days\n", capacity_mah, capacity_mah / average_ma / 24);
+    }
+    fclose(report);
+    return status;
+}
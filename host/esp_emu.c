@@ -0,0 +1,347 @@
+/**
+ * The parts of ESP-IDF the firmware uses, acting on the emulated board.
+ *
+ * Wi-Fi and the notification server are faked with fixed latencies so the
+ * firmware sees roughly the delays it would on a real network, and the
+ * radio on time can be measured. The battery monitor reads back the charge
+ * the emulator thinks is left.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_event_loop.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "driver/adc.h"
+#include "lwip/sockets.h"
+#include "emu.h"
+#include "sim.h"
+
+#define WIFI_START_US 50000 /* esp_wifi_start() to SYSTEM_EVENT_STA_START */
+#define WIFI_CONNECT_US 2500000 /* Association and DHCP */
+#define DNS_US 30000
+#define TCP_CONNECT_US 60000
+#define HTTP_RESPONSE_US 150000
+
+#define MAX_SOCKETS 8
+#define FIRST_FD 1000
+
+static const char *HTTP_RESPONSE = "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+typedef struct emu_socket_state {
+    bool in_use;
+    bool connected;
+    bool request_sent;
+    size_t response_offset;
+} emu_socket_state;
+
+emu_device emu;
+
+static system_event_cb_t event_cb;
+static void *event_ctx;
+static emu_socket_state sockets[MAX_SOCKETS];
+
+void emu_reset_peripherals(void)
+{
+    emu.ext0_enabled = false;
+    emu.timer_us = 0;
+    emu.radio_on = false;
+    emu.connected = false;
+    event_cb = NULL;
+    event_ctx = NULL;
+    memset(sockets, 0, sizeof(sockets));
+    i2c_sim_reset_drivers();
+}
+
+int emu_accel_pin(gpio_num_t pin)
+{
+    lis3dh_model_advance(&emu.accel, sim_now_us);
+    if (pin == EMU_INT1_PIN) {
+        return lis3dh_model_int1(&emu.accel);
+    }
+    if (pin == EMU_INT2_PIN) {
+        return lis3dh_model_int2(&emu.accel);
+    }
+    return 0;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num)
+{
+    return gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return emu_accel_pin(gpio_num);
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_deep_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level)
+{
+    emu.ext0_enabled = true;
+    emu.ext0_pin = gpio_num;
+    emu.ext0_level = level;
+    return ESP_OK;
+}
+
+esp_err_t esp_deep_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    emu.timer_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_deep_sleep_wakeup_cause_t esp_deep_sleep_get_wakeup_cause(void)
+{
+    return emu.wakeup_cause;
+}
+
+void esp_deep_sleep_start(void)
+{
+    fflush(stdout);
+    emu_enter_deep_sleep();
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit)
+{
+    return ESP_OK;
+}
+
+/**
+ * The battery monitor sees the cell through a 100k / 330k divider. Voltage
+ * is taken to fall linearly from 4.3V to 2.8V as the charge is used
+ */
+int adc1_get_voltage(adc1_channel_t channel)
+{
+    double charge = 1.0;
+    if (emu.battery_capacity_mah > 0) {
+        charge = 1.0 - emu.battery_used_mah / emu.battery_capacity_mah;
+        if (charge < 0) charge = 0;
+    }
+    double battery = 2.8 + (4.3 - 2.8) * charge;
+    double adc = battery * 330 / (100 + 330);
+    return (int)(adc / 3.3 * 4095);
+}
+
+static void radio_on(void)
+{
+    if (!emu.radio_on) {
+        emu.radio_on = true;
+        emu.radio_on_since_us = sim_now_us;
+    }
+}
+
+static void send_event(void *arg)
+{
+    system_event_t event;
+    event.event_id = (system_event_id_t)(intptr_t)arg;
+    if (event.event_id == SYSTEM_EVENT_STA_GOT_IP) {
+        emu.connected = true;
+    }
+    if (event_cb) {
+        event_cb(event_ctx, &event);
+    }
+}
+
+void tcpip_adapter_init(void)
+{
+}
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx)
+{
+    event_cb = cb;
+    event_ctx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    radio_on();
+    emu_post_callback(sim_now_us + WIFI_START_US, send_event, (void *)(intptr_t)SYSTEM_EVENT_STA_START);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!emu.radio_on) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    emu_post_callback(sim_now_us + WIFI_CONNECT_US, send_event, (void *)(intptr_t)SYSTEM_EVENT_STA_GOT_IP);
+    return ESP_OK;
+}
+
+static emu_socket_state *get_socket(int fd)
+{
+    if (fd < FIRST_FD || fd >= FIRST_FD + MAX_SOCKETS || !sockets[fd - FIRST_FD].in_use) {
+        errno = EBADF;
+        return NULL;
+    }
+    return &sockets[fd - FIRST_FD];
+}
+
+int emu_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res)
+{
+    *res = NULL;
+    if (!emu.connected) {
+        return EAI_AGAIN;
+    }
+    emu_block_us(DNS_US);
+
+    struct addrinfo *ai = calloc(1, sizeof(struct addrinfo) + sizeof(struct sockaddr_in));
+    struct sockaddr_in *addr = (struct sockaddr_in *)(ai + 1);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(atoi(service));
+    addr->sin_addr.s_addr = htonl(0xc0000201); // 192.0.2.1, reserved for documentation
+    ai->ai_family = AF_INET;
+    ai->ai_socktype = hints ? hints->ai_socktype : SOCK_STREAM;
+    ai->ai_addr = (struct sockaddr *)addr;
+    ai->ai_addrlen = sizeof(*addr);
+    *res = ai;
+    return 0;
+}
+
+void emu_freeaddrinfo(struct addrinfo *res)
+{
+    free(res);
+}
+
+int emu_socket(int domain, int type, int protocol)
+{
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        if (!sockets[i].in_use) {
+            memset(&sockets[i], 0, sizeof(sockets[i]));
+            sockets[i].in_use = true;
+            return FIRST_FD + i;
+        }
+    }
+    errno = ENFILE;
+    return -1;
+}
+
+int emu_connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    emu_socket_state *s = get_socket(fd);
+    if (s == NULL) {
+        return -1;
+    }
+    if (!emu.connected) {
+        errno = ENETUNREACH;
+        return -1;
+    }
+    emu_block_us(TCP_CONNECT_US);
+    s->connected = true;
+    return 0;
+}
+
+int emu_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    return get_socket(fd) ? 0 : -1;
+}
+
+int emu_listen(int fd, int backlog)
+{
+    return get_socket(fd) ? 0 : -1;
+}
+
+int emu_accept(int fd, struct sockaddr *addr, socklen_t *len)
+{
+    // Nobody ever connects to the emulated board
+    errno = ECONNABORTED;
+    return -1;
+}
+
+ssize_t emu_send(int fd, const void *buf, size_t len, int flags)
+{
+    return emu_write(fd, buf, len);
+}
+
+ssize_t emu_write(int fd, const void *buf, size_t len)
+{
+    emu_socket_state *s = get_socket(fd);
+    if (s == NULL) {
+        return -1;
+    }
+    if (!s->connected) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (!s->request_sent) {
+        s->request_sent = true;
+        emu.http_requests++;
+    }
+    return len;
+}
+
+ssize_t emu_read(int fd, void *buf, size_t len)
+{
+    emu_socket_state *s = get_socket(fd);
+    if (s == NULL) {
+        return -1;
+    }
+    if (!s->request_sent) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (s->response_offset == 0) {
+        emu_block_us(HTTP_RESPONSE_US);
+    }
+    size_t remaining = strlen(HTTP_RESPONSE) - s->response_offset;
+    if (len > remaining) {
+        len = remaining;
+    }
+    memcpy(buf, HTTP_RESPONSE + s->response_offset, len);
+    s->response_offset += len;
+    if (len > 0 && remaining == len) {
+        emu.http_responses++;
+    }
+    return len;
+}
+
+int emu_close(int fd)
+{
+    emu_socket_state *s = get_socket(fd);
+    if (s == NULL) {
+        return -1;
+    }
+    s->in_use = false;
+    return 0;
+}
@@ -0,0 +1,373 @@
+/**
+ * FreeRTOS tasks and event groups on a simulated clock.
+ *
+ * Each task gets a host thread but only one ever runs at a time: the
+ * scheduler hands a baton to the task it picks and waits for it back.
+ * When every task is blocked the clock jumps straight to the next delay or
+ * timeout to expire, so a task sitting in vTaskDelay(1000) costs no real
+ * time at all. Tasks run in order of when they became ready, which stands
+ * in for the equal priorities the firmware uses.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "emu.h"
+#include "sim.h"
+
+#define MAX_TASKS 16
+#define MAX_CALLBACKS 16
+#define NEVER UINT64_MAX
+
+uint64_t sim_now_us = 0;
+
+typedef enum {
+    TASK_READY,
+    TASK_DELAYED,
+    TASK_WAITING_BITS,
+    TASK_DELETED,
+} task_state;
+
+typedef struct event_group {
+    EventBits_t bits;
+} event_group;
+
+typedef struct emu_task {
+    const char *name;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_t thread;
+    sem_t baton;
+    bool started;
+    task_state state;
+    uint64_t wake_us;
+
+    event_group *group;
+    EventBits_t wait_bits;
+    bool wait_all;
+    bool clear_on_exit;
+    EventBits_t result_bits;
+} emu_task;
+
+typedef struct emu_callback {
+    uint64_t at_us;
+    void (*fn)(void *);
+    void *arg;
+} emu_callback;
+
+static emu_task tasks[MAX_TASKS];
+static int num_tasks;
+static emu_task *current;
+static sem_t scheduler_baton;
+static bool killing;
+static bool sleep_requested;
+
+static emu_callback callbacks[MAX_CALLBACKS];
+static int num_callbacks;
+
+static uint64_t to_us(TickType_t ticks)
+{
+    return (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+/**
+ * Give the baton back to the scheduler and wait until we are picked again
+ */
+static void block(void)
+{
+    emu_task *self = current;
+    sem_post(&scheduler_baton);
+    sem_wait(&self->baton);
+    if (killing) {
+        pthread_exit(NULL);
+    }
+}
+
+static void finish_task(void)
+{
+    current->state = TASK_DELETED;
+    sem_post(&scheduler_baton);
+    pthread_exit(NULL);
+}
+
+static void *task_main(void *arg)
+{
+    emu_task *task = arg;
+    sem_wait(&task->baton);
+    if (!killing) {
+        task->fn(task->arg);
+    }
+    if (killing) {
+        return NULL;
+    }
+    // Returning from a task function is an error on FreeRTOS, treat it as a delete
+    finish_task();
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask)
+{
+    if (num_tasks == MAX_TASKS) {
+        return pdFALSE;
+    }
+    emu_task *task = &tasks[num_tasks];
+    memset(task, 0, sizeof(*task));
+    task->name = pcName;
+    task->fn = pvTaskCode;
+    task->arg = pvParameters;
+    task->state = TASK_READY;
+    task->wake_us = sim_now_us;
+    sem_init(&task->baton, 0, 0);
+    if (pthread_create(&task->thread, NULL, task_main, task) != 0) {
+        sem_destroy(&task->baton);
+        return pdFALSE;
+    }
+    task->started = true;
+    num_tasks++;
+    if (pvCreatedTask) {
+        *pvCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    emu_task *task = xTaskToDelete ? xTaskToDelete : current;
+    if (task == current) {
+        finish_task();
+    }
+    // The thread stays parked on its baton until the boot is torn down
+    task->state = TASK_DELETED;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    current->state = TASK_DELAYED;
+    current->wake_us = sim_now_us + to_us(xTicksToDelay);
+    block();
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement)
+{
+    *pxPreviousWakeTime += xTimeIncrement;
+    uint64_t wake_us = to_us(*pxPreviousWakeTime);
+    current->state = TASK_DELAYED;
+    current->wake_us = wake_us > sim_now_us ? wake_us : sim_now_us;
+    block();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_now_us / 1000 / portTICK_PERIOD_MS;
+}
+
+void emu_block_us(uint64_t us)
+{
+    current->state = TASK_DELAYED;
+    current->wake_us = sim_now_us + us;
+    block();
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    event_group *group = xEventGroup;
+    group->bits |= uxBitsToSet;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    event_group *group = xEventGroup;
+    EventBits_t bits = group->bits;
+    group->bits &= ~uxBitsToClear;
+    return bits;
+}
+
+static bool bits_satisfied(const emu_task *task)
+{
+    EventBits_t set = task->group->bits & task->wait_bits;
+    return task->wait_all ? set == task->wait_bits : set != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits,
+                                TickType_t xTicksToWait)
+{
+    current->group = xEventGroup;
+    current->wait_bits = uxBitsToWaitFor;
+    current->wait_all = xWaitForAllBits;
+    current->clear_on_exit = xClearOnExit;
+    current->state = TASK_WAITING_BITS;
+    current->wake_us = xTicksToWait == portMAX_DELAY ? NEVER : sim_now_us + to_us(xTicksToWait);
+    block();
+    return current->result_bits;
+}
+
+void emu_post_callback(uint64_t at_us, void (*fn)(void *), void *arg)
+{
+    if (num_callbacks == MAX_CALLBACKS) {
+        abort();
+    }
+    emu_callback cb = { at_us, fn, arg };
+    callbacks[num_callbacks++] = cb;
+}
+
+/**
+ * Run the earliest callback that is due, if any
+ */
+static bool run_callback(void)
+{
+    int next = -1;
+    for (int i = 0; i < num_callbacks; i++) {
+        if (callbacks[i].at_us <= sim_now_us && (next < 0 || callbacks[i].at_us < callbacks[next].at_us)) {
+            next = i;
+        }
+    }
+    if (next < 0) {
+        return false;
+    }
+    emu_callback cb = callbacks[next];
+    callbacks[next] = callbacks[--num_callbacks];
+    cb.fn(cb.arg);
+    return true;
+}
+
+/**
+ * Pick the task that has been ready the longest. Tasks waiting on an event
+ * group become ready as soon as their bits are set
+ */
+static emu_task *pick_task(void)
+{
+    emu_task *best = NULL;
+    uint64_t best_ready = NEVER;
+
+    for (int i = 0; i < num_tasks; i++) {
+        emu_task *task = &tasks[i];
+        uint64_t ready_us;
+        if (task->state == TASK_DELETED) {
+            continue;
+        }
+        if (task->state == TASK_WAITING_BITS && bits_satisfied(task)) {
+            ready_us = sim_now_us;
+        } else {
+            ready_us = task->wake_us;
+        }
+        if (ready_us <= sim_now_us && (best == NULL || ready_us < best_ready)) {
+            best = task;
+            best_ready = ready_us;
+        }
+    }
+    return best;
+}
+
+static uint64_t next_event_us(void)
+{
+    uint64_t next = NEVER;
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].state != TASK_DELETED && tasks[i].wake_us < next) {
+            next = tasks[i].wake_us;
+        }
+    }
+    for (int i = 0; i < num_callbacks; i++) {
+        if (callbacks[i].at_us < next) {
+            next = callbacks[i].at_us;
+        }
+    }
+    return next;
+}
+
+static void resume(emu_task *task)
+{
+    if (task->state == TASK_WAITING_BITS) {
+        task->result_bits = task->group->bits;
+        if (bits_satisfied(task) && task->clear_on_exit) {
+            task->group->bits &= ~task->wait_bits;
+        }
+    }
+    task->state = TASK_READY;
+    current = task;
+    sem_post(&task->baton);
+    sem_wait(&scheduler_baton);
+    current = NULL;
+}
+
+/**
+ * Stop every thread left over from this boot
+ */
+static void tear_down(void)
+{
+    killing = true;
+    for (int i = 0; i < num_tasks; i++) {
+        sem_post(&tasks[i].baton);
+    }
+    for (int i = 0; i < num_tasks; i++) {
+        pthread_join(tasks[i].thread, NULL);
+        sem_destroy(&tasks[i].baton);
+    }
+    num_tasks = 0;
+    num_callbacks = 0;
+    killing = false;
+}
+
+static void run_entry(void *arg)
+{
+    void (*entry)(void) = (void (*)(void))arg;
+    entry();
+}
+
+emu_run_result emu_run_tasks(void (*entry)(void), uint64_t deadline_us)
+{
+    emu_run_result result;
+
+    sem_init(&scheduler_baton, 0, 0);
+    sleep_requested = false;
+    // app_main runs in the main task, which is deleted when it returns
+    xTaskCreate(run_entry, "main", 4096, (void *)entry, 1, NULL);
+
+    while (1) {
+        if (sleep_requested) {
+            result = EMU_RUN_SLEEP;
+            break;
+        }
+        if (run_callback()) {
+            continue;
+        }
+        emu_task *task = pick_task();
+        if (task) {
+            resume(task);
+            continue;
+        }
+        uint64_t next = next_event_us();
+        if (next == NEVER) {
+            result = EMU_RUN_IDLE;
+            break;
+        }
+        if (next > deadline_us) {
+            sim_now_us = deadline_us;
+            result = EMU_RUN_WATCHDOG;
+            break;
+        }
+        sim_now_us = next;
+    }
+
+    tear_down();
+    sem_destroy(&scheduler_baton);
+    return result;
+}
+
+void emu_enter_deep_sleep(void)
+{
+    sleep_requested = true;
+    finish_task();
+    abort();
+}
@@ -0,0 +1,35 @@
+/**
+ * Minimal FreeRTOS task API for host simulations that run on a single
+ * thread. Delays simply move the simulated clock forward.
+ */
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+uint64_t sim_now_us = 0;
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_now_us / 1000 / portTICK_PERIOD_MS;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    sim_now_us += (uint64_t)xTicksToDelay * portTICK_PERIOD_MS * 1000;
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement)
+{
+    *pxPreviousWakeTime += xTimeIncrement;
+    uint64_t wake_us = (uint64_t)*pxPreviousWakeTime * portTICK_PERIOD_MS * 1000;
+    if (wake_us > sim_now_us) {
+        sim_now_us = wake_us;
+    }
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    // There is only ever the one task, so deleting it ends the simulation
+    exit(0);
+}
@@ -0,0 +1,240 @@
+/**
+ * ESP-IDF I2C master driver API backed by simulated devices.
+ *
+ * Commands are queued on a link exactly as with the real driver and run
+ * against whichever devices are attached to the port when the link is
+ * started. Bus time is accounted at the configured clock speed so callers
+ * can see how long a batch of transactions would hold the bus.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "driver/i2c.h"
+#include "sim.h"
+
+#define MAX_DEVICES 8
+#define BITS_PER_BYTE 9 /* 8 data bits and an ack */
+
+typedef enum {
+    OP_START,
+    OP_STOP,
+    OP_WRITE,
+    OP_READ,
+} op_type;
+
+typedef struct i2c_op {
+    op_type type;
+    uint8_t byte;
+    uint8_t *data;
+    size_t len;
+    bool ack_check;
+    int ack;
+} i2c_op;
+
+typedef struct i2c_link {
+    i2c_op *ops;
+    size_t num_ops;
+    size_t cap_ops;
+} i2c_link;
+
+typedef struct i2c_device {
+    uint8_t address;
+    const i2c_sim_ops *ops;
+    void *dev;
+} i2c_device;
+
+typedef struct i2c_port_state {
+    uint32_t clk_speed;
+    bool installed;
+    i2c_device devices[MAX_DEVICES];
+    int num_devices;
+    i2c_sim_stats stats;
+} i2c_port_state;
+
+static i2c_port_state ports[I2C_NUM_MAX];
+
+void i2c_sim_attach(int port, uint8_t address, const i2c_sim_ops *ops, void *dev)
+{
+    if (port < 0 || port >= I2C_NUM_MAX || ports[port].num_devices == MAX_DEVICES) {
+        abort();
+    }
+    i2c_port_state *p = &ports[port];
+    i2c_device d = { address, ops, dev };
+    p->devices[p->num_devices++] = d;
+}
+
+void i2c_sim_reset_drivers(void)
+{
+    for (int i = 0; i < I2C_NUM_MAX; i++) {
+        ports[i].installed = false;
+        ports[i].clk_speed = 0;
+    }
+}
+
+const i2c_sim_stats *i2c_sim_get_stats(int port)
+{
+    return &ports[port].stats;
+}
+
+void i2c_sim_reset_stats(int port)
+{
+    memset(&ports[port].stats, 0, sizeof(i2c_sim_stats));
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num >= I2C_NUM_MAX || i2c_conf->mode != I2C_MODE_MASTER) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ports[i2c_num].clk_speed = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    if (i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ports[i2c_num].installed) {
+        return ESP_FAIL;
+    }
+    ports[i2c_num].installed = true;
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(i2c_link));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    i2c_link *link = cmd_handle;
+    free(link->ops);
+    free(link);
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd_handle, i2c_op op)
+{
+    i2c_link *link = cmd_handle;
+    if (link->num_ops == link->cap_ops) {
+        link->cap_ops = link->cap_ops ? link->cap_ops * 2 : 16;
+        link->ops = realloc(link->ops, link->cap_ops * sizeof(i2c_op));
+        if (link->ops == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    link->ops[link->num_ops++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    i2c_op op = { OP_START };
+    return add_op(cmd_handle, op);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    i2c_op op = { OP_STOP };
+    return add_op(cmd_handle, op);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    i2c_op op = { OP_WRITE, data, NULL, 1, ack_en };
+    return add_op(cmd_handle, op);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, bool ack_en)
+{
+    i2c_op op = { OP_WRITE, 0, data, data_len, ack_en };
+    return add_op(cmd_handle, op);
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, int ack)
+{
+    i2c_op op = { OP_READ, 0, data, 1, false, ack };
+    return add_op(cmd_handle, op);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, int ack)
+{
+    i2c_op op = { OP_READ, 0, data, data_len, false, ack };
+    return add_op(cmd_handle, op);
+}
+
+static i2c_device *find_device(i2c_port_state *p, uint8_t address)
+{
+    for (int i = 0; i < p->num_devices; i++) {
+        if (p->devices[i].address == address) {
+            return &p->devices[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    if (i2c_num >= I2C_NUM_MAX || !ports[i2c_num].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    i2c_port_state *p = &ports[i2c_num];
+    i2c_link *link = cmd_handle;
+
+    i2c_device *selected = NULL;
+    bool expect_address = false;
+    bool expect_pointer = false;
+    unsigned int bits = 0;
+    esp_err_t rc = ESP_OK;
+
+    for (size_t i = 0; i < link->num_ops && rc == ESP_OK; i++) {
+        i2c_op *op = &link->ops[i];
+        switch (op->type) {
+        case OP_START:
+            expect_address = true;
+            bits++;
+            break;
+        case OP_STOP:
+            selected = NULL;
+            bits++;
+            break;
+        case OP_WRITE:
+            for (size_t j = 0; j < op->len; j++) {
+                uint8_t byte = op->data ? op->data[j] : op->byte;
+                bits += BITS_PER_BYTE;
+                p->stats.bytes++;
+                if (expect_address) {
+                    expect_address = false;
+                    selected = find_device(p, byte >> 1);
+                    if (selected == NULL) {
+                        if (op->ack_check) {
+                            // Nobody acked the address
+                            rc = ESP_FAIL;
+                        }
+                        break;
+                    }
+                    selected->ops->select(selected->dev);
+                    expect_pointer = (byte & 1) == I2C_MASTER_WRITE;
+                } else if (selected) {
+                    selected->ops->write(selected->dev, byte, expect_pointer);
+                    expect_pointer = false;
+                }
+            }
+            break;
+        case OP_READ:
+            for (size_t j = 0; j < op->len; j++) {
+                bits += BITS_PER_BYTE;
+                p->stats.bytes++;
+                // With nothing driving the bus the pull ups read as 0xff
+                op->data[j] = selected ? selected->ops->read(selected->dev) : 0xff;
+            }
+            break;
+        }
+    }
+
+    p->stats.transactions++;
+    if (p->clk_speed) {
+        p->stats.busy_us += (uint64_t)bits * 1000000 / p->clk_speed;
+    }
+    return rc;
+}
@@ -0,0 +1,23 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef DRIVER_ADC_H_
+#define DRIVER_ADC_H_
+
+#include "esp_err.h"
+
+typedef enum {
+    ADC1_CHANNEL_0 = 0, ADC1_CHANNEL_1, ADC1_CHANNEL_2, ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4, ADC1_CHANNEL_5, ADC1_CHANNEL_6, ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX,
+} adc1_channel_t;
+
+typedef enum {
+    ADC_WIDTH_9Bit = 0,
+    ADC_WIDTH_10Bit,
+    ADC_WIDTH_11Bit,
+    ADC_WIDTH_12Bit,
+} adc_bits_width_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit);
+int adc1_get_voltage(adc1_channel_t channel);
+
+#endif
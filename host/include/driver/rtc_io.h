@@ -0,0 +1,10 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef DRIVER_RTC_IO_H_
+#define DRIVER_RTC_IO_H_
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num);
+
+#endif
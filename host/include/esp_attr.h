@@ -0,0 +1,8 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef ESP_ATTR_H_
+#define ESP_ATTR_H_
+
+/* The emulator saves this section across deep sleeps and reloads everything else */
+#define RTC_DATA_ATTR __attribute__((section("rtc_data"), used))
+
+#endif
@@ -0,0 +1,23 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef ESP_DEEP_SLEEP_H_
+#define ESP_DEEP_SLEEP_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    ESP_DEEP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_DEEP_SLEEP_WAKEUP_EXT0,
+    ESP_DEEP_SLEEP_WAKEUP_EXT1,
+    ESP_DEEP_SLEEP_WAKEUP_TIMER,
+    ESP_DEEP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_DEEP_SLEEP_WAKEUP_ULP,
+} esp_deep_sleep_wakeup_cause_t;
+
+esp_err_t esp_deep_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level);
+esp_err_t esp_deep_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_deep_sleep_wakeup_cause_t esp_deep_sleep_get_wakeup_cause(void);
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,26 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef ESP_EVENT_LOOP_H_
+#define ESP_EVENT_LOOP_H_
+
+#include "esp_err.h"
+
+typedef enum {
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+} system_event_id_t;
+
+typedef struct {
+    system_event_id_t event_id;
+} system_event_t;
+
+typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx);
+
+#endif
@@ -0,0 +1,14 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef ESP_SYSTEM_H_
+#define ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_deep_sleep.h"
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+
+#endif
@@ -0,0 +1,21 @@
+/* Host build stand in for the FreeRTOS header of the same name */
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+/* The Arduino framework builds FreeRTOS with a 1000hz tick */
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+
+#endif
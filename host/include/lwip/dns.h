@@ -0,0 +1,2 @@
+/* Host build stand in for the lwIP header of the same name. See lwip/sockets.h */
+#include "lwip/sockets.h"
@@ -0,0 +1,53 @@
+/**
+ * Host build stand in for lwIP's socket API. The types come from the host's
+ * own headers but the calls are redirected to the emulated network so the
+ * firmware never talks to the real one. Define SIM_HOST_SOCKETS to use the
+ * host's sockets instead, eg. to benchmark against a socketpair.
+ */
+#ifndef LWIP_SOCKETS_H_
+#define LWIP_SOCKETS_H_
+
+#include <stddef.h>
+#include <errno.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+int emu_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
+void emu_freeaddrinfo(struct addrinfo *res);
+int emu_socket(int domain, int type, int protocol);
+int emu_connect(int fd, const struct sockaddr *addr, socklen_t len);
+int emu_bind(int fd, const struct sockaddr *addr, socklen_t len);
+int emu_listen(int fd, int backlog);
+int emu_accept(int fd, struct sockaddr *addr, socklen_t *len);
+ssize_t emu_send(int fd, const void *buf, size_t len, int flags);
+ssize_t emu_write(int fd, const void *buf, size_t len);
+ssize_t emu_read(int fd, void *buf, size_t len);
+int emu_close(int fd);
+
+#ifndef SIM_HOST_SOCKETS
+#define getaddrinfo(node, service, hints, res) emu_getaddrinfo(node, service, hints, res)
+#define freeaddrinfo(res) emu_freeaddrinfo(res)
+#define socket(domain, type, protocol) emu_socket(domain, type, protocol)
+#define connect(fd, addr, len) emu_connect(fd, addr, len)
+#define bind(fd, addr, len) emu_bind(fd, addr, len)
+#define listen(fd, backlog) emu_listen(fd, backlog)
+#define accept(fd, addr, len) emu_accept(fd, addr, len)
+#define send(fd, buf, len, flags) emu_send(fd, buf, len, flags)
+#define write(fd, buf, len) emu_write(fd, buf, len)
+#define read(fd, buf, len) emu_read(fd, buf, len)
+#define close(fd) emu_close(fd)
+#else
+#include <unistd.h>
+/* As in lwIP, so the firmware can have a variable called socket */
+static inline int lwip_socket(int domain, int type, int protocol)
+{
+    return socket(domain, type, protocol);
+}
+#define socket(domain, type, protocol) lwip_socket(domain, type, protocol)
+#endif
+
+#endif
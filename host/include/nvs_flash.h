@@ -0,0 +1,9 @@
+/* Host build stand in for the ESP-IDF header of the same name */
+#ifndef NVS_FLASH_H_
+#define NVS_FLASH_H_
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+
+#endif
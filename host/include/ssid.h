@@ -0,0 +1,3 @@
+/* Placeholder network credentials for host builds */
+#define WIFI_SSID "emulator"
+#define WIFI_PASS "emulator"
@@ -0,0 +1,284 @@
+#include <string.h>
+#include "lis3dh.h"
+#include "lis3dh_model.h"
+#include "sim.h"
+
+#define FIFO_MODE_MASK 0xc0
+#define FIFO_MODE_BYPASS 0x00
+#define FIFO_MODE_FIFO 0x40
+#define FIFO_SRC_EMPTY 0x20
+#define INT_POLARITY 0x02 /* CTRL_REG6 interrupts active low */
+#define I1_IA1 0x40 /* CTRL_REG3 interrupt 1 on the INT1 pad */
+#define LIR_INT1 0x08 /* CTRL_REG5 latch interrupt 1 until INT1_SRC is read */
+#define INT1_CFG_AOI 0x80 /* AND rather than OR the enabled events */
+#define INT1_SRC_IA 0x40
+#define LOW_POWER_ODR 2 /* 10hz, used while the sleep-to-wake engine is inactive */
+
+/* Output data rates selected by CTRL_REG1 ODR3-ODR0, in hz */
+static const unsigned int ODR_HZ[16] = {
+    0, 1, 10, 25, 50, 100, 200, 400, 1600, 1344, 0, 0, 0, 0, 0, 0
+};
+
+void lis3dh_model_init(lis3dh_model *m, lis3dh_signal signal, void *ctx)
+{
+    memset(m, 0, sizeof(*m));
+    m->regs[WHO_AM_I] = WHO_AM_I_ID;
+    m->regs[CTRL_REG1] = 0x07; // Powered down, all axes enabled
+    m->signal = signal;
+    m->ctx = ctx;
+}
+
+uint64_t lis3dh_model_period_us(const lis3dh_model *m)
+{
+    unsigned int odr = m->regs[CTRL_REG1] >> 4;
+    if (m->inactive && odr > LOW_POWER_ODR) {
+        odr = LOW_POWER_ODR;
+    }
+    unsigned int hz = ODR_HZ[odr];
+    return hz ? 1000000 / hz : 0;
+}
+
+static bool fifo_enabled(const lis3dh_model *m)
+{
+    return (m->regs[CTRL_REG5] & FIFO_EN) &&
+           (m->regs[FIFO_CTRL_REG] & FIFO_MODE_MASK) != FIFO_MODE_BYPASS;
+}
+
+/**
+ * Sleep-to-wake: inactive once every axis has been under ACT_THS for
+ * 8 * ACT_DUR + 1 samples, active again on the first sample over it
+ */
+static void update_activity(lis3dh_model *m, const int16_t raw[3])
+{
+    if (m->regs[ACT_THS] == 0) {
+        m->inactive = false;
+        m->quiet_samples = 0;
+        return;
+    }
+    // 16mg per bit at 2g, 16 output units per mg
+    int threshold = (m->regs[ACT_THS] & 0x7f) * 16 * 16;
+    for (int i = 0; i < 3; i++) {
+        if (raw[i] > threshold || raw[i] < -threshold) {
+            m->inactive = false;
+            m->quiet_samples = 0;
+            return;
+        }
+    }
+    m->quiet_samples++;
+    if (m->quiet_samples >= 8 * (uint32_t)m->regs[ACT_DUR] + 1) {
+        m->inactive = true;
+    }
+}
+
+/**
+ * Interrupt generator 1. Each axis has a high and a low event, enabled
+ * in INT1_CFG with the same bit layout as they are reported in INT1_SRC.
+ * IA is raised once the combined condition has held for INT1_DURATION
+ * samples and, if latched, stays up until INT1_SRC is read
+ */
+static void update_int1(lis3dh_model *m, const int16_t raw[3])
+{
+    uint8_t cfg = m->regs[INT1_CFG];
+    uint8_t enabled = cfg & 0x3f;
+    int threshold = (m->regs[INT1_THS] & 0x7f) * 16 * 16;
+    uint8_t events = 0;
+
+    for (int i = 0; i < 3; i++) {
+        int value = raw[i] < 0 ? -raw[i] : raw[i];
+        events |= (value > threshold ? 2 : 1) << (i * 2);
+    }
+    events &= enabled;
+
+    bool condition = enabled && ((cfg & INT1_CFG_AOI) ? events == enabled : events != 0);
+    if (condition) {
+        m->int1_samples++;
+    } else {
+        m->int1_samples = 0;
+    }
+
+    bool active = condition && m->int1_samples > m->regs[INT1_DURATION];
+    if (m->int1_latched && (m->regs[CTRL_REG5] & LIR_INT1)) {
+        return;
+    }
+    m->int1_latched = active;
+    m->int1_src = active ? (INT1_SRC_IA | events) : events;
+}
+
+static void take_sample(lis3dh_model *m, uint64_t time_us)
+{
+    int16_t raw[3] = {0, 0, 0};
+    if (m->signal) {
+        m->signal(time_us, raw, m->ctx);
+    }
+    memcpy(m->out, raw, sizeof(raw));
+    m->samples++;
+    update_int1(m, raw);
+    update_activity(m, raw);
+
+    if (!fifo_enabled(m)) {
+        return;
+    }
+    if (m->fifo_count == LIS3DH_MODEL_FIFO_SIZE) {
+        if ((m->regs[FIFO_CTRL_REG] & FIFO_MODE_MASK) == FIFO_MODE_FIFO) {
+            // FIFO mode stops collecting once full
+            return;
+        }
+        // Stream mode discards the oldest sample
+        m->fifo_head = (m->fifo_head + 1) % LIS3DH_MODEL_FIFO_SIZE;
+        m->fifo_count--;
+        m->fifo_overrun = true;
+    }
+    int tail = (m->fifo_head + m->fifo_count) % LIS3DH_MODEL_FIFO_SIZE;
+    memcpy(m->fifo[tail], raw, sizeof(raw));
+    m->fifo_count++;
+}
+
+void lis3dh_model_advance(lis3dh_model *m, uint64_t now_us)
+{
+    uint64_t period = lis3dh_model_period_us(m);
+    if (period == 0) {
+        m->next_sample_us = 0;
+        return;
+    }
+    if (m->next_sample_us == 0) {
+        // Just powered up, the first sample is one period away
+        m->next_sample_us = now_us + period;
+        return;
+    }
+    while (m->next_sample_us <= now_us) {
+        take_sample(m, m->next_sample_us);
+        // The data rate drops while the sleep-to-wake engine is inactive
+        m->next_sample_us += lis3dh_model_period_us(m);
+    }
+}
+
+bool lis3dh_model_int1(const lis3dh_model *m)
+{
+    bool level = (m->regs[CTRL_REG3] & I1_IA1) && m->int1_latched;
+    return (m->regs[CTRL_REG6] & INT_POLARITY) ? !level : level;
+}
+
+bool lis3dh_model_int2(const lis3dh_model *m)
+{
+    bool level = (m->regs[CTRL_REG6] & I2_ACT) && m->inactive;
+    return (m->regs[CTRL_REG6] & INT_POLARITY) ? !level : level;
+}
+
+static const int16_t *current_sample(const lis3dh_model *m)
+{
+    if (fifo_enabled(m) && m->fifo_count > 0) {
+        return m->fifo[m->fifo_head];
+    }
+    return m->out;
+}
+
+static uint8_t read_register(lis3dh_model *m, uint8_t reg)
+{
+    if (reg >= REG_X && reg <= REG_Z + 1) {
+        int16_t value = current_sample(m)[(reg - REG_X) / 2];
+        uint8_t byte = (reg & 1) ? (uint16_t)value >> 8 : value & 0xff;
+
+        // Reading the last output register moves the FIFO on
+        if (reg == REG_Z + 1 && fifo_enabled(m) && m->fifo_count > 0) {
+            m->fifo_head = (m->fifo_head + 1) % LIS3DH_MODEL_FIFO_SIZE;
+            m->fifo_count--;
+            m->fifo_overrun = false;
+        }
+        return byte;
+    }
+
+    switch (reg) {
+    case INT1_SRC: {
+        // Reading the source clears a latched interrupt
+        uint8_t src = m->int1_src;
+        m->int1_latched = false;
+        m->int1_src &= ~INT1_SRC_IA;
+        return src;
+    }
+    case FIFO_SRC_REG: {
+        uint8_t src = m->fifo_count > FIFO_SRC_FSS ? FIFO_SRC_FSS : m->fifo_count;
+        if (m->fifo_overrun) src |= FIFO_SRC_OVRN;
+        if (m->fifo_count == 0) src |= FIFO_SRC_EMPTY;
+        return src;
+    }
+    default:
+        return m->regs[reg & 0x3f];
+    }
+}
+
+static void write_register(lis3dh_model *m, uint8_t reg, uint8_t value)
+{
+    switch (reg) {
+    case CTRL_REG1:
+        m->regs[reg] = value;
+        lis3dh_model_advance(m, sim_now_us);
+        break;
+    case FIFO_CTRL_REG:
+        // Passing through bypass mode empties the FIFO
+        if ((value & FIFO_MODE_MASK) == FIFO_MODE_BYPASS) {
+            m->fifo_head = 0;
+            m->fifo_count = 0;
+            m->fifo_overrun = false;
+        }
+        m->regs[reg] = value;
+        break;
+    case CTRL_REG2: case CTRL_REG3: case CTRL_REG4: case CTRL_REG5: case CTRL_REG6:
+    case INT1_CFG: case INT1_THS: case INT1_DURATION: case ACT_THS: case ACT_DUR:
+        m->regs[reg] = value;
+        break;
+    default:
+        // Read only or reserved
+        break;
+    }
+}
+
+static void next_register(lis3dh_model *m)
+{
+    if (!m->auto_increment) {
+        return;
+    }
+    // The FIFO read wrap around described at FIFO_EN
+    if (m->reg_ptr == REG_Z + 1 && fifo_enabled(m)) {
+        m->reg_ptr = REG_X;
+    } else {
+        m->reg_ptr = (m->reg_ptr + 1) & 0x7f;
+    }
+}
+
+static void model_select(void *dev)
+{
+    lis3dh_model *m = dev;
+    lis3dh_model_advance(m, sim_now_us);
+}
+
+static void model_write(void *dev, uint8_t value, bool pointer)
+{
+    lis3dh_model *m = dev;
+    if (pointer) {
+        // The MSB of the register address enables auto increment
+        m->reg_ptr = value & 0x7f;
+        m->auto_increment = value & 0x80;
+        return;
+    }
+    write_register(m, m->reg_ptr, value);
+    next_register(m);
+}
+
+static uint8_t model_read(void *dev)
+{
+    lis3dh_model *m = dev;
+    uint8_t value = read_register(m, m->reg_ptr);
+    next_register(m);
+    return value;
+}
+
+static const i2c_sim_ops MODEL_OPS = {
+    model_select,
+    model_write,
+    model_read,
+};
+
+void lis3dh_model_attach(lis3dh_model *m, int port, uint8_t address)
+{
+    i2c_sim_attach(port, address, &MODEL_OPS, m);
+}
@@ -0,0 +1,75 @@
+#ifndef lis3dh_model_H_
+#define lis3dh_model_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LIS3DH_MODEL_FIFO_SIZE 32
+
+/**
+ * Supplies the raw acceleration for each sample the model takes.
+ * Values are in the same units as the output registers, 16 per mg.
+ */
+typedef void (*lis3dh_signal)(uint64_t time_us, int16_t raw[3], void *ctx);
+
+/**
+ * Register level model of a LIS3DH. Samples are taken at the data rate
+ * selected in CTRL_REG1 as the simulated clock advances and go through
+ * the FIFO exactly as they would on the real part. The INT1 threshold
+ * interrupt and the sleep-to-wake engine (ACT_THS / ACT_DUR) work on the
+ * samples as given by the signal, ie. the signal should already be high
+ * pass filtered.
+ */
+typedef struct lis3dh_model {
+    uint8_t regs[0x40];
+    uint8_t reg_ptr;
+    bool auto_increment;
+
+    int16_t out[3];
+    int16_t fifo[LIS3DH_MODEL_FIFO_SIZE][3];
+    int fifo_head;
+    int fifo_count;
+    bool fifo_overrun;
+
+    uint8_t int1_src;
+    bool int1_latched;
+    uint32_t int1_samples;
+
+    bool inactive;
+    uint32_t quiet_samples;
+
+    uint64_t next_sample_us;
+    uint64_t samples;
+
+    lis3dh_signal signal;
+    void *ctx;
+} lis3dh_model;
+
+void lis3dh_model_init(lis3dh_model *m, lis3dh_signal signal, void *ctx);
+
+/**
+ * Take every sample that falls due up to now_us
+ */
+void lis3dh_model_advance(lis3dh_model *m, uint64_t now_us);
+
+/**
+ * Sample period for the data rate in CTRL_REG1, or 0 when powered down
+ */
+uint64_t lis3dh_model_period_us(const lis3dh_model *m);
+
+/**
+ * Level of the INT1 pad
+ */
+bool lis3dh_model_int1(const lis3dh_model *m);
+
+/**
+ * Level of the INT2 pad
+ */
+bool lis3dh_model_int2(const lis3dh_model *m);
+
+/**
+ * Attach the model to a simulated I2C bus
+ */
+void lis3dh_model_attach(lis3dh_model *m, int port, uint8_t address);
+
+#endif
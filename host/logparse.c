@@ -0,0 +1,497 @@
+/**
+ * Batch ingest of archived sensor logs.
+ *
+ * Reads the `timestamp,x,y,z,total,v,vibrations` lines printed by
+ * beaglebone/accel.py (including the `Washing done at` marker rows) and the
+ * `timestamp,v,b` lines printed by beaglebone/voltage.py. Each file is memory
+ * mapped and split into newline aligned chunks which are parsed on separate
+ * threads. The per-chunk results are stitched together in file order so that
+ * a wash cycle spanning a chunk (or file) boundary is still summarised once.
+ *
+ * Usage: logparse [-j threads] [-c min chunk bytes] file...
+ *
+ * Prints one `start,end,duration,peak_v` line per completed cycle to stdout
+ * and totals to stderr. Files are treated as one continuous log in the order
+ * given, so rotated logs should be passed oldest first. A cycle starts at the
+ * beginning of the run of non zero vibration counts that took the count over
+ * the machine on threshold, so a knock hours before the wash isn't counted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ACCEL_FIELDS 7
+#define VOLTAGE_FIELDS 3
+#define MARKER "Washing done at "
+#define MACHINE_ON_THRESHOLD 5000 /* machineonthreshold in accel.py */
+#define MIN_CHUNK (1 << 20)
+
+/**
+ * A run of accelerometer rows between two `Washing done` markers, parsed as
+ * if nothing came before it. start is the timestamp of the first row of the
+ * run of non zero vibration counts that crossed MACHINE_ON_THRESHOLD, or -1
+ * if there was none, and peak is the largest v from start onwards.
+ *
+ * The rest is needed to continue whatever was open at the end of the
+ * previous chunk: peak_all is the largest v over all the rows, run_start and
+ * run_peak describe the run of non zero counts still going at the end,
+ * lead_on is set if the machine came on during the run the segment opened
+ * with and unbroken if there were no zero counts at all.
+ */
+typedef struct segment {
+    int64_t start;
+    int64_t end;
+    double peak;
+    double peak_all;
+    int64_t run_start;
+    double run_peak;
+    int lead_on;
+    int unbroken;
+    int closed;
+} segment;
+
+typedef struct chunk {
+    const char *begin;
+    const char *end;
+
+    segment *segments;
+    size_t num_segments;
+    size_t cap_segments;
+
+    uint64_t accel_rows;
+    uint64_t voltage_rows;
+    uint64_t markers;
+    uint64_t bad_rows;
+    double min_battery;
+    double max_battery;
+} chunk;
+
+typedef struct totals {
+    segment carry;
+    uint64_t cycles;
+    uint64_t accel_rows;
+    uint64_t voltage_rows;
+    uint64_t markers;
+    uint64_t bad_rows;
+    double min_battery;
+    double max_battery;
+} totals;
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double scale10(double value, int exp)
+{
+    while (exp > 22) {
+        value *= 1e22;
+        exp -= 22;
+    }
+    while (exp < -22) {
+        value /= 1e22;
+        exp += 22;
+    }
+    return exp >= 0 ? value * POW10[exp] : value / POW10[-exp];
+}
+
+/**
+ * Parse a decimal number as printed by Python's str(float), eg. -0.0625,
+ * 1.23e-05 or nan. Accumulates up to 19 significant digits into an integer
+ * and applies the decimal exponent with a single multiply or divide. That is
+ * correctly rounded for up to 15 significant digits and exponents within
+ * 1e22, which covers the values in our logs. Longer mantissas are rounded
+ * once to a double and again by the scaling, so may be an ulp out. Returns
+ * NULL if no number was found.
+ */
+static const char *parse_double(const char *p, const char *end, double *out)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (end - p >= 3 && (memcmp(p, "nan", 3) == 0 || memcmp(p, "inf", 3) == 0)) {
+        *out = p[0] == 'n' ? NAN : (negative ? -INFINITY : INFINITY);
+        return p + 3;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exp = 0;
+    const char *start = p;
+
+    for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exp++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exp--;
+            }
+        }
+    }
+    if (p == start || (p == start + 1 && *start == '.')) {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int exp_negative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_negative = *q == '-';
+            q++;
+        }
+        int e = 0;
+        const char *digits_start = q;
+        for (; q < end && (unsigned)(*q - '0') < 10; q++) {
+            if (e < 10000) e = e * 10 + (*q - '0');
+        }
+        if (q != digits_start) {
+            exp += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = scale10((double)mantissa, exp);
+    *out = negative ? -value : value;
+    return p;
+}
+
+static const char *parse_int64(const char *p, const char *end, int64_t *out)
+{
+    int negative = 0;
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    const char *start = p;
+    int64_t value = 0;
+    for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+        value = value * 10 + (*p - '0');
+    }
+    if (p == start) {
+        return NULL;
+    }
+    *out = negative ? -value : value;
+    return p;
+}
+
+static segment *current_segment(chunk *c)
+{
+    return &c->segments[c->num_segments - 1];
+}
+
+static void push_segment(chunk *c)
+{
+    if (c->num_segments == c->cap_segments) {
+        c->cap_segments = c->cap_segments ? c->cap_segments * 2 : 16;
+        c->segments = realloc(c->segments, c->cap_segments * sizeof(segment));
+        if (c->segments == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    segment s = {-1, -1, 0.0, 0.0, -1, 0.0, 0, 1, 0};
+    c->segments[c->num_segments++] = s;
+}
+
+static void parse_line(chunk *c, const char *p, const char *end)
+{
+    // Tolerate CRLF line endings
+    if (end > p && end[-1] == '\r') {
+        end--;
+    }
+    if (p == end) {
+        return;
+    }
+
+    int64_t timestamp;
+    double fields[ACCEL_FIELDS - 1];
+    int num_fields = 1;
+
+    p = parse_int64(p, end, &timestamp);
+    if (p == NULL) {
+        c->bad_rows++;
+        return;
+    }
+    while (p < end && *p == ',' && num_fields < ACCEL_FIELDS) {
+        const char *next = parse_double(p + 1, end, &fields[num_fields - 1]);
+        if (next == NULL) {
+            break;
+        }
+        p = next;
+        num_fields++;
+    }
+
+    if (num_fields == ACCEL_FIELDS && p == end) {
+        double v = fields[4];
+        double vibrations = fields[5];
+        segment *s = current_segment(c);
+        c->accel_rows++;
+        if (v > s->peak_all) s->peak_all = v;
+        if (vibrations > 0) {
+            if (s->run_start < 0) {
+                s->run_start = timestamp;
+                s->run_peak = v;
+            } else if (v > s->run_peak) {
+                s->run_peak = v;
+            }
+            if (s->start < 0 && vibrations > MACHINE_ON_THRESHOLD) {
+                s->start = s->run_start;
+                s->peak = s->run_peak;
+                s->lead_on = s->unbroken;
+            }
+        } else {
+            s->run_start = -1;
+            s->run_peak = 0.0;
+            s->unbroken = 0;
+        }
+        if (s->start >= 0 && v > s->peak) s->peak = v;
+    } else if (num_fields == ACCEL_FIELDS && *p == ',' &&
+               (size_t)(end - p - 1) > strlen(MARKER) &&
+               memcmp(p + 1, MARKER, strlen(MARKER)) == 0) {
+        int64_t done;
+        if (parse_int64(p + 1 + strlen(MARKER), end, &done) == NULL) {
+            c->bad_rows++;
+            return;
+        }
+        segment *s = current_segment(c);
+        s->end = done;
+        s->closed = 1;
+        c->markers++;
+        push_segment(c);
+    } else if (num_fields == VOLTAGE_FIELDS && p == end) {
+        double b = fields[1];
+        if (c->voltage_rows == 0 || b < c->min_battery) c->min_battery = b;
+        if (c->voltage_rows == 0 || b > c->max_battery) c->max_battery = b;
+        c->voltage_rows++;
+    } else {
+        c->bad_rows++;
+    }
+}
+
+static void *parse_chunk(void *arg)
+{
+    chunk *c = arg;
+    const char *p = c->begin;
+
+    push_segment(c);
+    while (p < c->end) {
+        // memchr is vectorised in glibc, so finding the line ends is the
+        // cheap part. The field delimiters fall out of the number parsers.
+        const char *nl = memchr(p, '\n', c->end - p);
+        const char *eol = nl ? nl : c->end;
+        parse_line(c, p, eol);
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+static void print_cycle(totals *t, const segment *s)
+{
+    if (s->start < 0) {
+        return;
+    }
+    printf("%lld,%lld,%lld,%g\n", (long long)s->start, (long long)s->end,
+           (long long)(s->end - s->start), s->peak);
+    t->cycles++;
+}
+
+/**
+ * Fold a chunk's segments into the running totals. The first segment of a
+ * chunk continues whatever was still open at the end of the previous chunk,
+ * including a run of vibrations that only crosses the threshold in this one.
+ */
+static void merge_chunk(totals *t, chunk *c)
+{
+    for (size_t i = 0; i < c->num_segments; i++) {
+        segment *s = &c->segments[i];
+        segment *carry = &t->carry;
+
+        if (carry->start >= 0) {
+            if (s->peak_all > carry->peak) carry->peak = s->peak_all;
+        } else if (carry->run_start >= 0 && s->lead_on) {
+            carry->start = carry->run_start;
+            carry->peak = s->peak_all > carry->run_peak ? s->peak_all : carry->run_peak;
+        } else {
+            carry->start = s->start;
+            carry->peak = s->peak;
+        }
+
+        if (carry->run_start >= 0 && s->unbroken) {
+            if (s->peak_all > carry->run_peak) carry->run_peak = s->peak_all;
+        } else {
+            carry->run_start = s->run_start;
+            carry->run_peak = s->run_peak;
+        }
+
+        if (s->closed) {
+            carry->end = s->end;
+            print_cycle(t, carry);
+            segment empty = {-1, -1, 0.0, 0.0, -1, 0.0, 0, 1, 0};
+            *carry = empty;
+        }
+    }
+
+    if (c->voltage_rows) {
+        if (t->voltage_rows == 0 || c->min_battery < t->min_battery) t->min_battery = c->min_battery;
+        if (t->voltage_rows == 0 || c->max_battery > t->max_battery) t->max_battery = c->max_battery;
+    }
+    t->accel_rows += c->accel_rows;
+    t->voltage_rows += c->voltage_rows;
+    t->markers += c->markers;
+    t->bad_rows += c->bad_rows;
+}
+
+static int ingest_file(totals *t, const char *path, int num_threads, size_t min_chunk)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+        return -1;
+    }
+    // The chunks are read in parallel, so only ask for read ahead
+    madvise((void *)data, size, MADV_WILLNEED);
+
+    // Don't bother splitting small files, thread startup would dominate
+    if ((size_t)num_threads > size / min_chunk + 1) {
+        num_threads = size / min_chunk + 1;
+    }
+
+    chunk *chunks = calloc(num_threads, sizeof(chunk));
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    const char *end = data + size;
+    const char *p = data;
+
+    for (int i = 0; i < num_threads; i++) {
+        const char *chunk_end = i == num_threads - 1 ? end : data + size / num_threads * (i + 1);
+        if (chunk_end < p) {
+            chunk_end = p;
+        }
+        // Move the boundary forward to just past the next newline
+        if (chunk_end < end) {
+            const char *nl = memchr(chunk_end, '\n', end - chunk_end);
+            chunk_end = nl ? nl + 1 : end;
+        }
+        chunks[i].begin = p;
+        chunks[i].end = chunk_end;
+        p = chunk_end;
+    }
+
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, parse_chunk, &chunks[i]) != 0) {
+            // Fall back to parsing it on this thread
+            threads[i] = 0;
+            parse_chunk(&chunks[i]);
+        }
+    }
+    parse_chunk(&chunks[0]);
+
+    for (int i = 0; i < num_threads; i++) {
+        if (i > 0 && threads[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        merge_chunk(t, &chunks[i]);
+        free(chunks[i].segments);
+    }
+
+    free(chunks);
+    free(threads);
+    munmap((void *)data, size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long min_chunk = MIN_CHUNK;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:c:")) != -1) {
+        switch (opt) {
+        case 'j':
+            num_threads = atoi(optarg);
+            break;
+        case 'c':
+            min_chunk = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-j threads] [-c min chunk bytes] file...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-j threads] [-c min chunk bytes] file...\n", argv[0]);
+        return 2;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (min_chunk < 1) {
+        min_chunk = 1;
+    }
+
+    totals t;
+    memset(&t, 0, sizeof(t));
+    segment empty = {-1, -1, 0.0, 0.0, -1, 0.0, 0, 1, 0};
+    t.carry = empty;
+
+    printf("start,end,duration,peak_v\n");
+
+    int rc = 0;
+    for (int i = optind; i < argc; i++) {
+        if (ingest_file(&t, argv[i], num_threads, min_chunk) < 0) {
+            rc = 1;
+        }
+    }
+
+    fprintf(stderr, "Accelerometer rows: %llu\n", (unsigned long long)t.accel_rows);
+    fprintf(stderr, "Voltage rows: %llu\n", (unsigned long long)t.voltage_rows);
+    if (t.voltage_rows) {
+        fprintf(stderr, "Battery range: %.3f - %.3f\n", t.min_battery, t.max_battery);
+    }
+    fprintf(stderr, "Washing done markers: %llu\n", (unsigned long long)t.markers);
+    fprintf(stderr, "Cycles: %llu\n", (unsigned long long)t.cycles);
+    if (t.carry.start >= 0) {
+        fprintf(stderr, "Incomplete cycle started at %lld\n", (long long)t.carry.start);
+    }
+    if (t.bad_rows) {
+        fprintf(stderr, "Unparseable rows: %llu\n", (unsigned long long)t.bad_rows);
+    }
+    return rc;
+}
@@ -0,0 +1,18 @@
+/**
+ * Linked into the firmware library so the emulator can find the
+ * RTC_DATA_ATTR variables it has to carry over between boots
+ */
+#include <stddef.h>
+
+extern char __start_rtc_data[];
+extern char __stop_rtc_data[];
+
+char *emu_rtc_start(void)
+{
+    return __start_rtc_data;
+}
+
+size_t emu_rtc_size(void)
+{
+    return __stop_rtc_data - __start_rtc_data;
+}
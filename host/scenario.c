@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scenario.h"
+
+static int add_step(scenario *s, uint64_t start_us, int amplitude_mg)
+{
+    if (s->num_steps > 0 && start_us < s->steps[s->num_steps - 1].start_us) {
+        return -1;
+    }
+    scenario_step *steps = realloc(s->steps, (s->num_steps + 1) * sizeof(scenario_step));
+    if (steps == NULL) {
+        return -1;
+    }
+    s->steps = steps;
+    s->steps[s->num_steps].start_us = start_us;
+    s->steps[s->num_steps].amplitude_mg = amplitude_mg;
+    s->num_steps++;
+    return 0;
+}
+
+int scenario_load(scenario *s, const char *path)
+{
+    memset(s, 0, sizeof(*s));
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        double seconds;
+        int amplitude;
+        char extra;
+        if (sscanf(line, " repeat %lf %c", &seconds, &extra) == 1) {
+            s->period_us = seconds * 1000000;
+        } else if (sscanf(line, " %lf %d %c", &seconds, &amplitude, &extra) == 2) {
+            if (add_step(s, seconds * 1000000, amplitude) < 0) {
+                fprintf(stderr, "%s:%d: steps must be in time order\n", path, line_no);
+                fclose(f);
+                return -1;
+            }
+        } else if (strspn(line, " \t\r\n") != strlen(line)) {
+            fprintf(stderr, "%s:%d: expected `<seconds> <amplitude mg>`\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int scenario_amplitude(const scenario *s, uint64_t time_us)
+{
+    if (s->period_us) {
+        time_us %= s->period_us;
+    }
+    // Find the last step starting at or before time_us
+    size_t lo = 0, hi = s->num_steps;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s->steps[mid].start_us <= time_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? 0 : s->steps[lo - 1].amplitude_mg;
+}
+
+/* Cheap deterministic noise so runs are repeatable */
+static uint32_t noise(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+void scenario_signal(uint64_t time_us, int16_t raw[3], void *ctx)
+{
+    const scenario *s = ctx;
+    int amplitude = scenario_amplitude(s, time_us) * 16;
+    for (int i = 0; i < 3; i++) {
+        int32_t n = (int32_t)(noise(time_us * 3 + i) % 2001) - 1000;
+        raw[i] = amplitude * n / 1000;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef scenario_H_
+#define scenario_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct scenario_step {
+    uint64_t start_us;
+    int amplitude_mg;
+} scenario_step;
+
+/**
+ * Vibration felt by the sensor over time. Loaded from a text file with one
+ * `<seconds> <amplitude mg>` line per change in vibration level. A
+ * `repeat <seconds>` line makes the whole scenario loop with that period.
+ */
+typedef struct scenario {
+    scenario_step *steps;
+    size_t num_steps;
+    uint64_t period_us;
+} scenario;
+
+/**
+ * Returns 0 on success or -1 if the file couldn't be read or parsed
+ */
+int scenario_load(scenario *s, const char *path);
+
+int scenario_amplitude(const scenario *s, uint64_t time_us);
+
+/**
+ * lis3dh_signal that shakes every axis with random values of up to the
+ * scenario's amplitude. ctx is the scenario
+ */
+void scenario_signal(uint64_t time_us, int16_t raw[3], void *ctx);
+
+#endif
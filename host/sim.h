@@ -0,0 +1,44 @@
+#ifndef sim_H_
+#define sim_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Simulated time in microseconds. FreeRTOS ticks and every
+ * simulated peripheral are driven from this one clock
+ */
+extern uint64_t sim_now_us;
+
+/**
+ * Callbacks for a device on a simulated I2C bus. select is called on
+ * every (repeated) start addressed to the device. The first byte written
+ * after selecting for write is flagged as the register pointer
+ */
+typedef struct i2c_sim_ops {
+    void (*select)(void *dev);
+    void (*write)(void *dev, uint8_t value, bool pointer);
+    uint8_t (*read)(void *dev);
+} i2c_sim_ops;
+
+typedef struct i2c_sim_stats {
+    unsigned int transactions;
+    unsigned int bytes;
+    uint64_t busy_us;
+} i2c_sim_stats;
+
+void i2c_sim_attach(int port, uint8_t address, const i2c_sim_ops *ops, void *dev);
+
+/**
+ * Forget which drivers are installed, as after a reset.
+ * Attached devices stay where they are
+ */
+void i2c_sim_reset_drivers(void);
+
+/**
+ * Bus usage counters, reset with i2c_sim_reset_stats
+ */
+const i2c_sim_stats *i2c_sim_get_stats(int port);
+void i2c_sim_reset_stats(int port);
+
+#endif
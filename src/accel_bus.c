@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c.h"
+#include "accel_bus.h"
+
+#define WRITE_BIT  I2C_MASTER_WRITE /*!< I2C master write */
+#define READ_BIT   I2C_MASTER_READ  /*!< I2C master read */
+#define ACK_CHECK_EN   0x1     /*!< I2C master will check ack from slave*/
+#define ACK_VAL    0x0         /*!< I2C ack value */
+#define NACK_VAL   0x1         /*!< I2C nack value */
+
+//Set the MSB of the register address to read several registers in one go
+#define AUTO_INCREMENT 0x80
+
+static const char* TAG = "accel_bus";
+
+void accel_bus_init(accel_bus *bus, i2c_port_t port, accel_samples_cb callback, void *ctx)
+{
+  memset(bus, 0, sizeof(*bus));
+  bus->port = port;
+  bus->callback = callback;
+  bus->ctx = ctx;
+}
+
+bool accel_bus_add(accel_bus *bus, uint8_t address)
+{
+  if (bus->num_sensors == ACCEL_BUS_MAX_SENSORS) {
+    ESP_LOGE(TAG, "Too many sensors on bus %d", bus->port);
+    return false;
+  }
+
+  accel_sensor *sensor = &bus->sensors[bus->num_sensors];
+  memset(sensor, 0, sizeof(*sensor));
+  sensor->dev.port = bus->port;
+  sensor->dev.address = address;
+
+  if (!init_i2c_device(&sensor->dev)) {
+    return false;
+  }
+  //50hz, which ACCEL_BUS_POLL_MS is chosen for. Enable X, Y and Z axes
+  write_reg(&sensor->dev, CTRL_REG1, 0x47);
+  //BDU, little endian, +-2g, high resolution
+  write_reg(&sensor->dev, CTRL_REG4, 0x88);
+  enable_fifo(&sensor->dev);
+  bus->num_sensors++;
+  return true;
+}
+
+/**
+ * Queue a register read on an existing command link. The register address
+ * is written and then read back after a repeated start, so any number of
+ * these can share a single transaction
+ */
+static void queue_read(i2c_cmd_handle_t cmd, const lis3dh_dev *dev, uint8_t reg_addr, uint8_t *data, size_t len)
+{
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (dev->address << 1) | WRITE_BIT, ACK_CHECK_EN);
+  i2c_master_write_byte(cmd, reg_addr, ACK_CHECK_EN);
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (dev->address << 1) | READ_BIT, ACK_CHECK_EN);
+  if (len > 1) {
+    i2c_master_read(cmd, data, len - 1, ACK_VAL);
+  }
+  i2c_master_read_byte(cmd, data + len - 1, NACK_VAL);
+}
+
+esp_err_t accel_bus_poll(accel_bus *bus)
+{
+  if (bus->num_sensors == 0) {
+    return ESP_OK;
+  }
+
+  // First find out how many samples are waiting in each FIFO
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  for (int i = 0; i < bus->num_sensors; i++) {
+    accel_sensor *sensor = &bus->sensors[i];
+    queue_read(cmd, &sensor->dev, FIFO_SRC_REG, &sensor->fifo_src, 1);
+  }
+  i2c_master_stop(cmd);
+  esp_err_t rc = i2c_master_cmd_begin(bus->port, cmd, 100 / portTICK_PERIOD_MS);
+  i2c_cmd_link_delete(cmd);
+  if (rc != ESP_OK) {
+    return rc;
+  }
+
+  // Then drain them back to back, one burst per sensor (see FIFO_EN)
+  int pending = 0;
+  cmd = i2c_cmd_link_create();
+  for (int i = 0; i < bus->num_sensors; i++) {
+    accel_sensor *sensor = &bus->sensors[i];
+    int count = sensor->fifo_src & FIFO_SRC_FSS;
+    if (count > 0) {
+      queue_read(cmd, &sensor->dev, REG_X | AUTO_INCREMENT, sensor->data, count * 6);
+      pending++;
+    }
+  }
+  if (pending > 0) {
+    i2c_master_stop(cmd);
+    rc = i2c_master_cmd_begin(bus->port, cmd, 100 / portTICK_PERIOD_MS);
+  }
+  i2c_cmd_link_delete(cmd);
+  if (rc != ESP_OK) {
+    return rc;
+  }
+
+  for (int i = 0; i < bus->num_sensors; i++) {
+    accel_sensor *sensor = &bus->sensors[i];
+    int count = sensor->fifo_src & FIFO_SRC_FSS;
+    if (sensor->fifo_src & FIFO_SRC_OVRN) {
+      // We weren't quick enough and the oldest samples were overwritten
+      sensor->overruns++;
+    }
+    if (count > 0) {
+      decode_acceleration(sensor->data, sensor->samples, count);
+      sensor->total_samples += count;
+      if (bus->callback) {
+        bus->callback(&sensor->dev, sensor->samples, count, bus->ctx);
+      }
+    }
+  }
+  return ESP_OK;
+}
+
+void accel_bus_task(void *pvParameter)
+{
+  accel_bus *bus = (accel_bus *)pvParameter;
+  TickType_t last_wake = xTaskGetTickCount();
+
+  while (1) {
+    esp_err_t rc = accel_bus_poll(bus);
+    if (rc != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to drain bus %d: %d", bus->port, rc);
+    }
+    vTaskDelayUntil(&last_wake, ACCEL_BUS_POLL_MS / portTICK_PERIOD_MS);
+  }
+
+  vTaskDelete(NULL);
+}
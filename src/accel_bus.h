@@ -0,0 +1,62 @@
+#ifndef accel_bus_H_
+#define accel_bus_H_
+
+#include "lis3dh.h"
+
+/* The LIS3DH only has two addresses so there can be at most two per bus */
+#define ACCEL_BUS_MAX_SENSORS 2
+
+/* How often each bus is drained. At 50hz the 32 sample FIFO lasts 640ms */
+#define ACCEL_BUS_POLL_MS 200
+
+/**
+ * Called from the bus task with the samples drained from one sensor
+ */
+typedef void (*accel_samples_cb)(const lis3dh_dev *dev, const accel_values *samples, int count, void *ctx);
+
+typedef struct accel_sensor {
+    lis3dh_dev dev;
+    uint8_t fifo_src;
+    uint8_t data[FIFO_SIZE * 6];
+    accel_values samples[FIFO_SIZE];
+    unsigned int total_samples;
+    unsigned int overruns;
+} accel_sensor;
+
+/**
+ * All the accelerometers on one I2C controller. Each poll drains
+ * every sensor's FIFO using two bus transactions in total: one to read
+ * all the FIFO_SRC registers and one to burst read all the samples.
+ *
+ * main.c only has the one sensor and doesn't use this yet. For now it is
+ * run against the simulated bus by host/bussim.
+ */
+typedef struct accel_bus {
+    i2c_port_t port;
+    accel_sensor sensors[ACCEL_BUS_MAX_SENSORS];
+    int num_sensors;
+    accel_samples_cb callback;
+    void *ctx;
+} accel_bus;
+
+void accel_bus_init(accel_bus *bus, i2c_port_t port, accel_samples_cb callback, void *ctx);
+
+/**
+ * Probe for a sensor at the given address and put its FIFO into
+ * stream mode. Returns false if nothing answered
+ */
+bool accel_bus_add(accel_bus *bus, uint8_t address);
+
+/**
+ * Drain the FIFOs of all sensors on the bus and hand the samples
+ * to the callback
+ */
+esp_err_t accel_bus_poll(accel_bus *bus);
+
+/**
+ * Task that polls one bus forever. Start one per bus so that
+ * the I2C controllers run in parallel
+ */
+void accel_bus_task(void *pvParameter);
+
+#endif
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include "activity.h"
+
+//ACT_DUR for a number of seconds of quiet. The sensor counts 8 * ACT_DUR + 1 samples
+#define ACT_DUR_SECONDS(s) (((s) * ACTIVITY_ODR_HZ - 1) / 8)
+
+void activity_init(const lis3dh_dev *dev, activity_wakeup *wakeup)
+{
+  printf("Enabling accelerometer activity detection\n");
+
+  write_reg(dev, CTRL_REG1, 0x27); //Set data rate to 10hz. Enable X, Y and Z axes
+  write_reg(dev, CTRL_REG4, 0x88); //BDU, high resolution, +-2g
+  write_reg(dev, CTRL_REG2, 0x08); //High-pass filter the data so gravity doesn't count as activity
+  write_reg(dev, CTRL_REG3, 0x00); //Nothing on INT1
+  write_reg(dev, CTRL_REG5, 0x00);
+  read_reg(dev, HP_FILTER_RESET);
+
+  enable_activity_detection(dev, ACTIVITY_THRESHOLD, ACT_DUR_SECONDS(ACTIVITY_START_QUIET_SECONDS));
+
+  //INT2 says active until the sensor has counted ACT_DUR quiet samples, so
+  //don't read anything into it before then
+  wakeup->wake_on_inactive = true;
+  wakeup->timer_seconds = 0;
+}
+
+static machine_state wait_for_activity(const lis3dh_dev *dev, activity_wakeup *wakeup)
+{
+  write_reg(dev, ACT_DUR, ACT_DUR_SECONDS(ACTIVITY_START_QUIET_SECONDS));
+  wakeup->wake_on_inactive = false;
+  wakeup->timer_seconds = 0;
+  return MACHINE_IDLE;
+}
+
+machine_state activity_update(const lis3dh_dev *dev, machine_state state, bool inactive, activity_wakeup *wakeup)
+{
+  switch (state) {
+  case MACHINE_STARTING:
+    if (inactive) {
+      printf("Vibration stopped before the machine was on\n");
+      return wait_for_activity(dev, wakeup);
+    }
+    //Still vibrating when the timer went off
+    printf("MACHINE ON! Sleeping until it stops.\n");
+    write_reg(dev, ACT_DUR, ACT_DUR_SECONDS(ACTIVITY_DONE_QUIET_SECONDS));
+    wakeup->wake_on_inactive = true;
+    wakeup->timer_seconds = 0;
+    return MACHINE_RUNNING;
+
+  case MACHINE_RUNNING:
+    wakeup->wake_on_inactive = true;
+    wakeup->timer_seconds = 0;
+    if (!inactive) {
+      return MACHINE_RUNNING;
+    }
+    printf("Machine off.\n");
+    wait_for_activity(dev, wakeup);
+    return MACHINE_DONE;
+
+  case MACHINE_IDLE:
+  case MACHINE_DONE:
+  default:
+    if (inactive) {
+      return wait_for_activity(dev, wakeup);
+    }
+    printf("Vibration detected. Waiting to see if it keeps going.\n");
+    wakeup->wake_on_inactive = true;
+    wakeup->timer_seconds = ACTIVITY_START_SECONDS;
+    return MACHINE_STARTING;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef activity_H_
+#define activity_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lis3dh.h"
+
+#define ACTIVITY_ODR_HZ 10 //Data rate used while the sensor does the timing
+#define ACTIVITY_THRESHOLD 0x04 //Vibration threshold as a multiple of 16mg. 4 * 16 = 64mg
+#define ACTIVITY_START_SECONDS 240 //Machine on after 4 minutes of vibration
+#define ACTIVITY_START_QUIET_SECONDS 10 //Quiet time that cancels a start
+#define ACTIVITY_DONE_QUIET_SECONDS 75 //Quiet time after which a running machine is done
+
+/**
+ * Where the machine is in its cycle. Kept in RTC memory between wake ups
+ */
+typedef enum {
+    MACHINE_IDLE = 0,
+    MACHINE_STARTING,
+    MACHINE_RUNNING,
+    MACHINE_DONE,
+} machine_state;
+
+/**
+ * What should wake us up next. wake_on_inactive selects the INT2 level to
+ * wait for (high for inactive, low for active) and timer_seconds, if non
+ * zero, wakes us regardless after that long
+ */
+typedef struct activity_wakeup {
+    bool wake_on_inactive;
+    uint32_t timer_seconds;
+} activity_wakeup;
+
+/**
+ * Program the accelerometer's own activity detection and route it to INT2.
+ * Only needed after power on, the sensor keeps it while we deep sleep.
+ * INT2 reads active until the sensor has seen a full quiet period, so this
+ * also sets wakeup to wait for that before the state machine starts, idle
+ */
+void activity_init(const lis3dh_dev *dev, activity_wakeup *wakeup);
+
+/**
+ * Work out the new machine state after waking up with INT2 at the given
+ * level, reprogram the sensor for it and say what we should sleep until.
+ * Returns MACHINE_DONE when the notification should be sent
+ */
+machine_state activity_update(const lis3dh_dev *dev, machine_state state, bool inactive, activity_wakeup *wakeup);
+
+#endif
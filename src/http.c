@@ -6,6 +6,7 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -139,6 +140,50 @@ void initialise_wifi()
 }
 
 
+/**
+ * Read the server's reply to a request until it closes the connection.
+ * Returns true if the request was accepted
+ */
+bool read_http_response(int socket)
+{
+    char* response = calloc(1, 1);
+    if (response == NULL) {
+        return false;
+    }
+    char recv_buf[64];
+    int responselen = 0;
+    int r = 0;
+
+    // Stop on an error as well as at the end, r is -1 then
+    while ((r = read(socket, recv_buf, sizeof(recv_buf)-1)) > 0) {
+        char* grown = realloc(response, responselen + r + 1);
+        if (grown == NULL) {
+            free(response);
+            return false;
+        }
+        response = grown;
+        memcpy(response + responselen, recv_buf, r);
+        responselen += r;
+        response[responselen] = 0;
+    }
+
+    printf("Response length: %d\n", responselen);
+    printf("Response: %s\n", response);
+    const char *success = "HTTP/1.1 200 OK";
+    bool sent = strncmp(success, response, strlen(success)) == 0;
+    if (sent) {
+        printf("Notification successful");
+    }
+
+    free(response);
+
+    printf("\n");
+    ESP_LOGI(TAG, "... done reading from socket. Last read return=%d errno=%d\r\n", r, errno);
+    printf("... done reading from socket. Last read return=%d errno=%d\n", r, errno);
+
+    return sent;
+}
+
 void http_get_task()
 {
     const struct addrinfo hints = {
@@ -220,38 +265,13 @@ void http_get_task()
         ESP_LOGI(TAG, "... socket send success");
         printf("... socket send success\n");
 
-        /* Read HTTP response */
-        char* response = NULL;
-        char recv_buf[64];
-        int responselen = 0;
-        int r = 0;
-
-        do {
-            bzero(recv_buf, sizeof(recv_buf));
-            r = read(socket, recv_buf, sizeof(recv_buf)-1);
-            for (int i = 0; i < 64; i++) {
-              printf("%d\n", recv_buf[i]);
-            }
-            responselen += r;
-            response = realloc(response, responselen+1);
-            strcat(response, recv_buf);
-        } while(r > 0);
-
-        printf("Response length: %d\n", responselen);
-        printf("Actual length: %d\n", strlen(response));
-        printf("Response: %s\n", response);
-        printf("Find: %d\n", strncmp("HTTP/1.1 200 OK", response, responselen));
-        if (strncmp("HTTP/1.1 200 OK", response, responselen) == 0) {
-            printf("Notification successful");
-        }
-
-        free(response);
-
-        printf("\n");
-        ESP_LOGI(TAG, "... done reading from socket. Last read return=%d errno=%d\r\n", r, errno);
-        printf("... done reading from socket. Last read return=%d errno=%d\n", r, errno);
+        bool sent = read_http_response(socket);
         close(socket);
 
+        if (sent) {
+            return;
+        }
+
         // Retry
         vTaskDelay(5000);
     }
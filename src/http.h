@@ -1,4 +1,7 @@
+#include <stdbool.h>
 
 void http_get_task();
 
 void initialise_wifi();
+
+bool read_http_response(int socket);
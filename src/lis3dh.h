@@ -2,6 +2,52 @@
 #define lis3dh_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "driver/i2c.h"
+
+/* I2C addresses. The SA0 pin selects which one the device answers to */
+#define LIS3DH_ADDR_LOW 0x18
+#define LIS3DH_ADDR_HIGH 0x19
+
+#define WHO_AM_I 0x0f /* Address of id register */
+#define WHO_AM_I_ID 0x33
+#define CTRL_REG1 0x20 //Data rate selection and X, Y, Z axis enable register
+#define CTRL_REG2 0x21 //High pass filter selection
+#define CTRL_REG3 0x22 //Control interrupts
+#define CTRL_REG4 0x23 //BDU
+#define CTRL_REG5 0x24 //FIFO enable / latch interrupts
+#define CTRL_REG6 0x25 //Route interrupts to the INT2 pad
+
+//Read this value to set the reference values against which accel values are compared when calculating a threshold interrupt
+//Also called the REFERENCE register in the datasheet
+#define HP_FILTER_RESET 0x26
+
+/* Acceleration value registers */
+#define REG_X 0x28
+#define REG_Y 0x2A
+#define REG_Z 0x2C
+
+#define FIFO_CTRL_REG 0x2E //FIFO mode selection
+#define FIFO_SRC_REG 0x2F //FIFO status and number of unread samples
+
+#define INT1_CFG 0x30 //Interrupt 1 config
+#define INT1_SRC 0x31 //Interrupt status - read in order to reset the latch
+#define INT1_THS 0x32 //Define threshold in mg to trigger interrupt
+#define INT1_DURATION 0x33 //Define duration for the interrupt to be recognised (not sure about this one)
+
+#define ACT_THS 0x3E //Sleep-to-wake / return-to-sleep threshold, 16mg per bit at 2g
+#define ACT_DUR 0x3F //Return-to-sleep duration, (8 * ACT_DUR + 1) samples
+
+#define I2_ACT 0x08 //CTRL_REG6 activity interrupt on INT2. INT2 is high while the device is inactive
+/* With FIFO_EN set the sensor buffers up to FIFO_SIZE samples so they can
+ * be read in bursts. An auto incrementing read from REG_X then wraps around
+ * from OUT_Z_H back to OUT_X_L, popping the next sample each time, so the
+ * whole FIFO can be drained in one transfer */
+#define FIFO_EN 0x40 //CTRL_REG5 FIFO enable bit
+#define FIFO_MODE_STREAM 0x80 //FIFO_CTRL_REG stream mode: oldest samples are overwritten when full
+#define FIFO_SRC_OVRN 0x40 //FIFO_SRC_REG set when a sample has been overwritten
+#define FIFO_SRC_FSS 0x1f //FIFO_SRC_REG number of unread samples
+#define FIFO_SIZE 32
 
 typedef struct accel_values {
     uint16_t x;
@@ -9,28 +55,62 @@ typedef struct accel_values {
     uint16_t z;
 } accel_values;
 
-void write_byte(uint8_t value);
+/**
+ * An accelerometer attached to one of the I2C buses
+ */
+typedef struct lis3dh_dev {
+    i2c_port_t port;
+    uint8_t address;
+} lis3dh_dev;
+
+void write_byte(const lis3dh_dev *dev, uint8_t value);
 
 /**
  * Write value to register
  */
-void write_reg(uint8_t reg_addr, uint8_t value);
+void write_reg(const lis3dh_dev *dev, uint8_t reg_addr, uint8_t value);
 
 /**
  * Read register
  */
-uint8_t read_reg(uint8_t reg_addr);
+uint8_t read_reg(const lis3dh_dev *dev, uint8_t reg_addr);
 
 /**
  * Read acceleration values. Reads the 6 bytes
  * at the given address and returns them as an
  * array of 3 uint16_ts
  */
-accel_values read_acceleration();
+accel_values read_acceleration(const lis3dh_dev *dev);
+
+/**
+ * Decode the little endian x, y, z samples read in a burst
+ * from the output registers
+ */
+void decode_acceleration(const uint8_t *data, accel_values *values, int count);
+
+/**
+ * Switch the FIFO into stream mode so samples can be drained in bursts
+ */
+void enable_fifo(const lis3dh_dev *dev);
+
+/**
+ * Let the accelerometer track activity itself. It is inactive once every
+ * axis has stayed below threshold (16mg per bit) for 8 * duration + 1
+ * samples and becomes active again as soon as one goes over. INT2 is
+ * driven high while it is inactive
+ */
+void enable_activity_detection(const lis3dh_dev *dev, uint8_t threshold, uint8_t duration);
+
+/**
+ * Configure an I2C controller as bus master. Only needs
+ * to be called once per bus, however many devices are on it
+ */
+void init_i2c_bus(i2c_port_t port, gpio_num_t sda, gpio_num_t scl);
 
 /**
- * Initalise the accelerometer as an I2C slave
+ * Check that the accelerometer is answering on its bus.
+ * Returns false if it is missing or returned the wrong id
  */
-void init_i2c_device();
+bool init_i2c_device(const lis3dh_dev *dev);
 
 #endif
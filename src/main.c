@@ -8,7 +8,9 @@
 #include "esp_event_loop.h"
 #include "nvs_flash.h"
 #include "driver/gpio.h"
+#include "driver/rtc_io.h"
 #include "lis3dh.h"
+#include "activity.h"
 #include "http.h"
 
 #define LOW 0
@@ -16,45 +18,44 @@
 
 #define LED_PIN GPIO_NUM_23  //Blue led pin
 #define INT_PIN GPIO_NUM_32 //Interrupt GPIO pin
+#define INT2_PIN GPIO_NUM_33 //Accelerometer INT2, high while the sensor thinks it is inactive
 
-#define ACCEL 0x19 //I2C device address
-#define CTRL_REG1 0x20 //Data rate selection and X, Y, Z axis enable register
-#define CTRL_REG2 0x21 //High pass filter selection
-#define CTRL_REG3 0x22 //Control interrupts
-#define CTRL_REG4 0x23 //BDU
-#define CTRL_REG5 0x24 //FIFO enable / latch interrupts
-
-#define INT1_CFG 0x30 //Interrupt 1 config
-#define INT1_SRC 0x31 //Interrupt status - read in order to reset the latch
-#define INT1_THS 0x32 //Define threshold in mg to trigger interrupt
-#define INT1_DURATION 0x33 //Define duration for the interrupt to be recognised (not sure about this one)
-
-//Read this value to set the reference values against which accel values are compared when calculating a threshold interrupt
-//Also called the REFERENCE register in the datasheet
-#define HP_FILTER_RESET 0x26
-
-#define REG_X 0x28
-#define REG_Y 0x2A
-#define REG_Z 0x2C
+#define I2C_MASTER_SCL_IO GPIO_NUM_22 //gpio number for I2C master clock
+#define I2C_MASTER_SDA_IO GPIO_NUM_21 //gpio number for I2C master data
 
 #define uS_TO_S_FACTOR 1000000  /* Conversion factor for micro seconds to seconds */
+#define SENSOR_RETRY_DELAY 60   /* Sleep for this long before looking for a missing accelerometer again */
 #define NOTIFICATION_DELAY 300  /* Sleep for this amount of time after detecting machine on before sending a notification */
 
 #define ACTIVE_THRESHOLD 240 //Trigger machine on after 4 minutes of vibration
 #define INACTIVE_ACTIVE_THRESHOLD 75 //Time to stay awake while inactive and active count is > 0
 #define INACTIVE_THRESHOLD 10 //Time to stay awake while inactive and active count is 0
 
+//Set to 1 to have the accelerometer time activity and inactivity itself on INT2.
+//We then stay in deep sleep for the whole cycle and only wake when it changes
+#ifndef SENSOR_ACTIVITY_DETECTION
+#define SENSOR_ACTIVITY_DETECTION 0
+#endif
+
 RTC_DATA_ATTR int bootCount = 0;
 RTC_DATA_ATTR bool sendNotification = false;
+RTC_DATA_ATTR machine_state machineState = MACHINE_IDLE;
+//Set once the accelerometer has been set up for activity detection
+RTC_DATA_ATTR bool activityConfigured = false;
+
+//What to wake up on next when using sensor activity detection
+activity_wakeup activityWakeup = { false, 0 };
 
 volatile bool active = true;
 
+static const lis3dh_dev accel_dev = { I2C_NUM_0, LIS3DH_ADDR_HIGH };
+
 float getAccel(int16_t accel) {
   return (float)accel / 16000;
 }
 
 void printAccel() {
-  accel_values accel = read_acceleration();
+  accel_values accel = read_acceleration(&accel_dev);
 
   printf("Read: %f, %f, %f\n", getAccel(accel.x), getAccel(accel.y), getAccel(accel.z));
 
@@ -63,17 +64,21 @@ void printAccel() {
 
 void set_sensitivity(uint8_t threshold) {
     // Threshold as a multiple of 16mg. 4 * 16 = 64mg
-    write_reg(INT1_THS, threshold);
+    write_reg(&accel_dev, INT1_THS, threshold);
 }
 
-void init_accelerometer()
+bool init_accelerometer()
 {
 
   printf("Initialising accelerometer\n");
 
-  init_i2c_device();
+  init_i2c_bus(I2C_NUM_0, I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO);
+  if (!init_i2c_device(&accel_dev)) {
+    printf("Accelerometer not found. Skipping setup\n");
+    return false;
+  }
 
-  write_reg(CTRL_REG1, 0x47); //Set data rate to 50hz. Enable X, Y and Z axes
+  write_reg(&accel_dev, CTRL_REG1, 0x47); //Set data rate to 50hz. Enable X, Y and Z axes
 
   //1 - BDU: Block data update. This ensures that both the high and the low bytes for each 16bit represent the same sample
   //0 - BLE: Big/little endian. Set to little endian
@@ -81,33 +86,43 @@ void init_accelerometer()
   //1 - HR: High resolution mode enabled.
   //00 - ST1-ST0: Self test. Disabled
   //0 - SIM: SPI serial interface mode. Default is 0
-  write_reg(CTRL_REG4, 0x88);
+  write_reg(&accel_dev, CTRL_REG4, 0x88);
 
   // 2 Write 09h into CTRL_REG2 // High-pass filter enabled on data and interrupt1
-  write_reg(CTRL_REG2, 0x09);
+  write_reg(&accel_dev, CTRL_REG2, 0x09);
 
   //3 Write 40h into CTRL_REG3 // Interrupt driven to INT1 pad
-  write_reg(CTRL_REG3, 0x40);
+  write_reg(&accel_dev, CTRL_REG3, 0x40);
 
   //4 Write 00h into CTRL_REG4 // FS = 2 g
   //5 Write 08h into CTRL_REG5 // Interrupt latched
-  write_reg(CTRL_REG5, 0x08);
+  write_reg(&accel_dev, CTRL_REG5, 0x08);
 
   // Threshold as a multiple of 16mg. 4 * 16 = 64mg
   set_sensitivity(0x05);
 
   // Duration = 0 not quite sure what this does yet
-  write_reg(INT1_DURATION, 0x00);
+  write_reg(&accel_dev, INT1_DURATION, 0x00);
 
   // Read the reference register to set the reference acceleration values against which
   // we compare current values for interrupt generation
   // 8 Read HP_FILTER_RESET
-  read_reg(HP_FILTER_RESET);
+  read_reg(&accel_dev, HP_FILTER_RESET);
 
   // 9 Write 2Ah into INT1_CFG // Configure interrupt when any of the X, Y or Z axes exceeds (rather than stay below) the threshold
-  write_reg(INT1_CFG, 0x2a);
+  write_reg(&accel_dev, INT1_CFG, 0x2a);
 
   printf("Accelerometer enabled\n");
+  return true;
+}
+
+void sleep_until_retry() {
+  //The sensor may have been reset or replaced by the time we find it again
+  activityConfigured = false;
+  printf("Looking for the accelerometer again in %d seconds\n", SENSOR_RETRY_DELAY);
+  fflush(stdout);
+  esp_deep_sleep_enable_timer_wakeup(SENSOR_RETRY_DELAY * uS_TO_S_FACTOR);
+  esp_deep_sleep_start();
 }
 
 void blink_task(void *pvParameter)
@@ -147,7 +162,7 @@ void check_vibrations(void *pvParameter)
   unsigned int time_active = 0;
   unsigned int time_inactive = 0;
   while (1) {
-    uint8_t interrupt_src = read_reg(INT1_SRC);
+    uint8_t interrupt_src = read_reg(&accel_dev, INT1_SRC);
     //the 7th bit is the IA or "interrupt active" bit
     if (interrupt_src & 0x40) {
       time_active++;
@@ -213,6 +228,14 @@ void print_wakeup_reason(){
   fflush(stdout);
 }
 
+void sleep_until_activity_change() {
+  esp_deep_sleep_enable_ext0_wakeup(INT2_PIN, activityWakeup.wake_on_inactive ? HIGH : LOW);
+  if (activityWakeup.timer_seconds) {
+    esp_deep_sleep_enable_timer_wakeup((uint64_t)activityWakeup.timer_seconds * uS_TO_S_FACTOR);
+  }
+  esp_deep_sleep_start();
+}
+
 void send_http_notification(void *pvParameters) {
   initialise_wifi();
   http_get_task();
@@ -220,13 +243,58 @@ void send_http_notification(void *pvParameters) {
   printf("Wifi message sent. Sleeping.\n");
   sendNotification = false;
 
+  if (SENSOR_ACTIVITY_DETECTION) {
+    sleep_until_activity_change();
+  }
+
   // Need to reset the interrupt before sleeping
-  uint8_t interrupt_src = read_reg(INT1_SRC);
+  read_reg(&accel_dev, INT1_SRC);
   esp_deep_sleep_enable_ext0_wakeup(INT_PIN, HIGH);
   esp_deep_sleep_start();
 }
 
-static const char *TAG = "washing";
+/**
+ * Wake up handling when the accelerometer is doing the activity timing.
+ * We only get here when INT2 changed or the start timer ran out, so look
+ * at where the machine is and go straight back to sleep
+ */
+void check_activity() {
+  esp_deep_sleep_wakeup_cause_t wakeup_reason = esp_deep_sleep_get_wakeup_cause();
+
+  init_i2c_bus(I2C_NUM_0, I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO);
+  if (!init_i2c_device(&accel_dev)) {
+    printf("Accelerometer not found\n");
+    sleep_until_retry();
+    return;
+  }
+  if (!activityConfigured ||
+      (wakeup_reason != ESP_DEEP_SLEEP_WAKEUP_EXT0 && wakeup_reason != ESP_DEEP_SLEEP_WAKEUP_TIMER)) {
+    //Power on, or the sensor wasn't there last time. It needs setting up
+    //from scratch, and then we stay idle until it has settled
+    activity_init(&accel_dev, &activityWakeup);
+    activityConfigured = true;
+    machineState = MACHINE_IDLE;
+    fflush(stdout);
+    sleep_until_activity_change();
+    return;
+  }
+
+  //An ext0 wake leaves the pad with the RTC IO mux, hand it back first
+  rtc_gpio_deinit(INT2_PIN);
+  gpio_set_direction(INT2_PIN, GPIO_MODE_INPUT);
+  bool inactive = gpio_get_level(INT2_PIN);
+  machineState = activity_update(&accel_dev, machineState, inactive, &activityWakeup);
+
+  if (machineState == MACHINE_DONE) {
+    printf("Turning on wifi\n");
+    sendNotification = true;
+    xTaskCreate(&blink_task, "blink_task", 2048, NULL, 5, NULL);
+    xTaskCreate(&send_http_notification, "send_http_notification", 8192, NULL, 5, NULL);
+  } else {
+    fflush(stdout);
+    sleep_until_activity_change();
+  }
+}
 
 void app_main() {
   nvs_flash_init();
@@ -240,9 +308,15 @@ void app_main() {
   //Print the wakeup reason for ESP32
   print_wakeup_reason();
 
-  init_accelerometer();
+  if (SENSOR_ACTIVITY_DETECTION) {
+    check_activity();
+    return;
+  }
 
-  sendNotification = true;
+  if (!init_accelerometer()) {
+    sleep_until_retry();
+    return;
+  }
 
   if (sendNotification) {
     printf("Turning on wifi\n");
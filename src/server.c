@@ -1,8 +1,12 @@
 
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include <lwip/sockets.h>
 #include <errno.h>
+#include "server.h"
 
 //Socket stuff
 #define PORT_NUMBER 8001
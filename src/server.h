@@ -1,3 +1,10 @@
+#include <stdbool.h>
 
 int socket_send(int clientSocket, char* data, int len, int foo);
 void start_server(void *args);
+
+/**
+ * Called by start_server with each connection it accepts, which it closes
+ * afterwards. Return false to stop accepting connections
+ */
+bool client_connected(int clientSocket);